@@ -0,0 +1,144 @@
+#include "conversion.h"
+#include "OT/iknp.h"
+#include "utils/io_utils.h"
+#include <fmt/core.h>
+#include <memory>
+
+namespace sci {
+
+inline uint64_t ring_mask(int ring_bits) {
+	return ring_bits >= 64 ? ~0ULL : (1ULL << ring_bits) - 1;
+}
+
+ConversionContext::ConversionContext(int party, NetIO* io) : party(party), io(io) {}
+
+ConversionContext::~ConversionContext() = default;
+
+IKNP<NetIO>* ConversionContext::cot() {
+	if (!iknp) {
+		iknp = std::make_unique<IKNP<NetIO>>(io);
+		if (party == ALICE)
+			iknp->setup_send();
+		else
+			iknp->setup_recv();
+	}
+	return iknp.get();
+}
+
+std::vector<uint64_t> to_xor_shares(const IntegerArray& values) {
+	std::vector<uint64_t> shares(values.size(), 0);
+	for (size_t i = 0; i < values.size(); i++) {
+		utils::check(values[i].size() <= 64, fmt::format("[Conversion] Values of {} bits do not fit in a share. ", values[i].size()));
+		for (int j = 0; j < values[i].size(); j++)
+			shares[i] |= (uint64_t)getLSB(values[i].bits[j].bit) << j;
+	}
+	return shares;
+}
+
+std::vector<uint64_t> to_xor_shares(const BitArray& values) {
+	std::vector<uint64_t> shares(values.size());
+	for (size_t i = 0; i < values.size(); i++)
+		shares[i] = getLSB(values[i].bit);
+	return shares;
+}
+
+IntegerArray from_xor_shares(const std::vector<uint64_t>& shares, int bitlength, int party) {
+	int n = shares.size();
+	int total_length = n * bitlength;
+	std::vector<uint8_t> bits(total_length, 0), zeros(total_length, 0);
+	for (int i = 0; i < n; i++)
+		int_to_bool((bool*)bits.data() + i * bitlength, shares[i], bitlength);
+	std::vector<Bit> A_bits(total_length), B_bits(total_length);
+	prot_exec->feed((block128 *)A_bits.data(), ALICE, (bool*)(party == ALICE ? bits.data() : zeros.data()), total_length);
+	prot_exec->feed((block128 *)B_bits.data(), BOB, (bool*)(party == BOB ? bits.data() : zeros.data()), total_length);
+
+	IntegerArray result(n);
+	for (int i = 0; i < n; i++) {
+		result[i].bits.resize(bitlength);
+		for (int j = 0; j < bitlength; j++)
+			result[i][j] = A_bits[i * bitlength + j] ^ B_bits[i * bitlength + j];
+	}
+	return result;
+}
+
+// With x = a ^ b, x = a + b - 2 * sum_j 2^j a_j b_j. For every bit j, BOB receives r + b_j * (-2^(j+1) a_j) for ALICE's
+// random r, which gives the products as additive shares (-r on ALICE's side).
+std::vector<uint64_t> xor_to_additive(const std::vector<uint64_t>& shares, int value_bits, int ring_bits, ConversionContext& ctx) {
+	utils::check(value_bits <= ring_bits && ring_bits <= 64, fmt::format("[Conversion] Cannot convert {}-bit values mod 2^{}. ", value_bits, ring_bits));
+	uint64_t mask = ring_mask(ring_bits);
+	int n = shares.size();
+	int num_cots = n * value_bits;
+	std::vector<uint64_t> cot_data(num_cots);
+	auto ot = ctx.cot();
+
+	std::vector<uint64_t> result(n);
+	if (ctx.party == ALICE) {
+		std::vector<uint64_t> corr(num_cots);
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < value_bits; j++)
+				corr[i * value_bits + j] = j + 1 < 64 ? (-(((shares[i] >> j) & 1) << (j + 1))) & mask : 0;
+		ot->send_cot(cot_data.data(), corr.data(), num_cots, ring_bits);
+		for (int i = 0; i < n; i++) {
+			result[i] = shares[i] & mask;
+			for (int j = 0; j < value_bits; j++)
+				result[i] -= cot_data[i * value_bits + j];
+			result[i] &= mask;
+		}
+	} else {
+		std::unique_ptr<bool[]> choices(new bool[num_cots]);
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < value_bits; j++)
+				choices[i * value_bits + j] = (shares[i] >> j) & 1;
+		ot->recv_cot(cot_data.data(), choices.get(), num_cots, ring_bits);
+		for (int i = 0; i < n; i++) {
+			result[i] = shares[i] & mask;
+			for (int j = 0; j < value_bits; j++)
+				result[i] += cot_data[i * value_bits + j];
+			result[i] &= mask;
+		}
+	}
+	ctx.io->flush();
+	return result;
+}
+
+std::vector<uint64_t> to_additive_shares(const IntegerArray& values, ConversionContext& ctx, int ring_bits) {
+	int value_bits = values.empty() ? 1 : values[0].size();
+	for (auto& value : values)
+		utils::check(value.size() == value_bits, "[Conversion] All values must have the same width. ");
+	return xor_to_additive(to_xor_shares(values), value_bits, ring_bits ? ring_bits : value_bits, ctx);
+}
+
+std::vector<uint64_t> to_additive_shares(const BitArray& values, ConversionContext& ctx, int ring_bits) {
+	return xor_to_additive(to_xor_shares(values), 1, ring_bits, ctx);
+}
+
+std::vector<uint64_t> to_shares(const IntegerArray& values, ShareType type, ConversionContext& ctx, int ring_bits) {
+	if (type == ShareType::xor_shares)
+		return to_xor_shares(values);
+	return to_additive_shares(values, ctx, ring_bits);
+}
+
+std::vector<uint64_t> open_shares(const std::vector<uint64_t>& shares, int ring_bits, int to_party, int party, NetIO* io) {
+	int n = shares.size();
+	std::vector<uint64_t> peer(n, 0), result(n, 0);
+	// ALICE goes first, so that the two parties never block on each other's sends
+	bool send = to_party == PUBLIC || to_party != party;
+	bool recv = to_party == PUBLIC || to_party == party;
+	if (party == ALICE && send) {
+		io->send_data(shares.data(), n * sizeof(uint64_t));
+		io->flush();
+	}
+	if (recv)
+		io->recv_data(peer.data(), n * sizeof(uint64_t));
+	if (party == BOB && send) {
+		io->send_data(shares.data(), n * sizeof(uint64_t));
+		io->flush();
+	}
+	if (!recv)
+		return result;
+	for (int i = 0; i < n; i++)
+		result[i] = ring_bits ? (shares[i] + peer[i]) & ring_mask(ring_bits) : shares[i] ^ peer[i];
+	return result;
+}
+
+} // namespace sci
@@ -0,0 +1,58 @@
+#ifndef FABLE_CONVERSION_H__
+#define FABLE_CONVERSION_H__
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "utils/net_io_channel.h"
+#include "custom_types.h"
+
+namespace sci {
+
+// Conversions of GC values (e.g. the results of fable_lookup) into plain shares, so that linear work after the lookup
+// (sums, counts) runs locally instead of through GC adders. Shares are uint64_t, so values are at most 64 bits.
+
+// Y2B: XOR shares of every value, without communication. Under free-XOR, the point-and-permute bit of ALICE's
+// zero-label and of BOB's active label XOR to the plain bit.
+std::vector<uint64_t> to_xor_shares(const IntegerArray& values);
+std::vector<uint64_t> to_xor_shares(const BitArray& values);
+
+// B2Y: GC values of bitlength bits from XOR shares. Both parties feed their shares and the circuit XORs them;
+// BOB's bits take one OT each.
+IntegerArray from_xor_shares(const std::vector<uint64_t>& shares, int bitlength, int party);
+
+template<typename IO> class IKNP;
+
+// The correlated OTs of B2A over io, with ALICE as the sender. The base OTs run on the first conversion, and are
+// reused by later ones. Owned by the caller next to its channel: it must not outlive io, nor be used by two threads at once.
+class ConversionContext {
+public:
+	ConversionContext(int party, NetIO* io);
+	~ConversionContext();
+
+	int party;
+	NetIO* io;
+	IKNP<NetIO>* cot();
+
+private:
+	std::unique_ptr<IKNP<NetIO>> iknp;
+};
+
+// B2A: additive shares mod 2^ring_bits of XOR-shared values of value_bits <= ring_bits bits.
+// Takes one correlated OT per value bit (ALICE sends, BOB receives) and a single round.
+std::vector<uint64_t> xor_to_additive(const std::vector<uint64_t>& shares, int value_bits, int ring_bits, ConversionContext& ctx);
+
+// Y2A: additive shares mod 2^ring_bits of every value; ring_bits defaults to the width of the values
+std::vector<uint64_t> to_additive_shares(const IntegerArray& values, ConversionContext& ctx, int ring_bits = 0);
+std::vector<uint64_t> to_additive_shares(const BitArray& values, ConversionContext& ctx, int ring_bits);
+
+// Output modes of a lookup: the results as XOR shares (Y2B) or additive shares (Y2A)
+enum class ShareType { xor_shares = 0, additive = 1 };
+std::vector<uint64_t> to_shares(const IntegerArray& values, ShareType type, ConversionContext& ctx, int ring_bits = 0);
+
+// Opens shares to one party (or both with PUBLIC): additive shares are added mod 2^ring_bits, XOR shares (ring_bits = 0) are XORed.
+// The other party gets zeros.
+std::vector<uint64_t> open_shares(const std::vector<uint64_t>& shares, int ring_bits, int to_party, int party, NetIO* io);
+
+} // namespace sci
+#endif
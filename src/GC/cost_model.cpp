@@ -0,0 +1,297 @@
+#include "cost_model.h"
+#include "lowmc.h"
+#include "utils/io_utils.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace sci {
+
+// Bytes on the wire per GC primitive under half-gates garbling and IKNP correlated OT
+const int LABEL_BYTES = 16;
+const int AND_GATE_BYTES = 2 * LABEL_BYTES;
+
+// The OPRF circuits. A LowMC S-box (lowmc.h) takes 3 AND gates, and its key schedule is linear.
+// AES-128 (aes.cpp) takes 10 rounds of 16 S-boxes, plus one SubWord of 4 S-boxes per round key, and each
+// Boyar-Peralta S-box takes 32 AND gates.
+const uint64_t LOWMC_SBOX_AND_GATES = 3;
+const uint64_t AES_ROUNDS = 10, AES_BLOCK_BITS = 128, AES_KEY_BITS = 128;
+const uint64_t AES_SBOXES_PER_ROUND = 16, AES_KEY_SBOXES_PER_ROUND = 4, AES_SBOX_AND_GATES = 32;
+
+static uint64_t bitonic_merge_comparators(uint64_t n) {
+	if (n <= 1)
+		return 0;
+	uint64_t m = 1;
+	while (m * 2 < n)
+		m *= 2;
+	return (n - m) + bitonic_merge_comparators(m) + bitonic_merge_comparators(n - m);
+}
+
+uint64_t bitonic_comparators(uint64_t n) {
+	if (n <= 1)
+		return 0;
+	uint64_t m = n / 2;
+	return bitonic_comparators(m) + bitonic_comparators(n - m) + bitonic_merge_comparators(n);
+}
+
+FABLEShape fable_shape(BatchPirParams* params, uint64_t batch_size, uint64_t db_size, int num_shards, bool fuse) {
+	return FABLEShape{
+		batch_size,
+		(uint64_t)params->get_num_buckets(),
+		db_size,
+		num_shards,
+		(int)params->get_hash_type(),
+		fuse,
+		DatabaseConstants::InputLength,
+		LUT_OUTPUT_SIZE,
+		DatabaseConstants::NumHashFunctions,
+		(uint64_t)params->query_size[0] * params->query_size[1] * params->query_size[2],
+		(uint64_t)params->response_size[0] * params->response_size[1]
+	};
+}
+
+static void add_gc_traffic(PhaseCost& cost) {
+	cost.alice_bytes += cost.and_gates * AND_GATE_BYTES + (cost.garbler_input_bits + cost.ot_bits) * LABEL_BYTES + cost.revealed_bits;
+	cost.bob_bytes += cost.ot_bits * LABEL_BYTES;
+}
+
+static void add_time(PhaseCost& cost, const CostProfile& profile) {
+	cost.ms += cost.and_gates / profile.and_gates_per_s * 1e3;
+	cost.ms += cost.ot_bits / profile.ots_per_s * 1e3;
+	cost.ms += (cost.alice_bytes + cost.bob_bytes) * 8 / (profile.bandwidth_mbps * 1e3);
+	cost.ms += cost.rounds * profile.rtt_ms;
+}
+
+std::vector<PhaseCost> predict_fable_cost(const FABLEShape& shape, const CostProfile& profile) {
+	// Shards answer the queries routed to them, so their buckets are concatenated, with w slots each
+	uint64_t n = shape.batch_size, S = shape.num_shards, B = S * shape.num_buckets;
+	// Queries carry one bit more than the LUT index, so that deduplicated slots can hold dummies
+	uint64_t query_bits = shape.index_bits + 1, entry_bits = shape.entry_bits;
+	uint64_t num_slots = shape.num_hash;
+	uint64_t batch_comparators = bitonic_comparators(n), bucket_comparators = bitonic_comparators(B);
+
+	// Every comparator, equality test, If and swap on a k-bit integer costs k AND gates
+	PhaseCost dedup{"Deduplicate"};
+	dedup.and_gates = 2 * query_bits * batch_comparators + 2 * query_bits * (n - 1);
+
+	PhaseCost oprf{"OPRF Evaluation"};
+	if (shape.hash_type == (int)HashType::LowMC) {
+		// The batch is bitsliced, so every S-box AND gate is one gate per query
+		oprf.garbler_input_bits = keysize;
+		oprf.and_gates = (uint64_t)rounds * numofboxes * LOWMC_SBOX_AND_GATES * n;
+		oprf.revealed_bits = (uint64_t)blocksize * n;
+	} else {
+		// The batch is encrypted once per hash function, with its own prefix; the key is expanded once
+		oprf.garbler_input_bits = AES_KEY_BITS + shape.num_hash * (AES_BLOCK_BITS - shape.index_bits);
+		oprf.and_gates = shape.num_hash * AES_ROUNDS * AES_SBOXES_PER_ROUND * AES_SBOX_AND_GATES * n
+			+ AES_ROUNDS * AES_KEY_SBOXES_PER_ROUND * AES_SBOX_AND_GATES;
+		oprf.revealed_bits = shape.num_hash * AES_BLOCK_BITS * n;
+	}
+	if (S > 1) {
+		// The shard of every query is the low word of one more AES encryption under ALICE's routing key
+		oprf.garbler_input_bits += AES_KEY_BITS;
+		oprf.and_gates += AES_ROUNDS * AES_SBOXES_PER_ROUND * AES_SBOX_AND_GATES * n + AES_ROUNDS * AES_KEY_SBOXES_PER_ROUND * AES_SBOX_AND_GATES;
+		oprf.revealed_bits += 64 * n;
+	}
+	oprf.rounds = 1;
+
+	PhaseCost retrieval{"Share Retrieval"};
+	uint64_t shared_bits = num_slots * B * (shape.index_bits + entry_bits);
+	retrieval.garbler_input_bits = shared_bits;
+	retrieval.ot_bits = shared_bits;
+	retrieval.he_ciphertexts = S * (shape.query_ciphertexts + shape.response_ciphertexts);
+	retrieval.bob_bytes = S * shape.query_ciphertexts * profile.query_ciphertext_bytes;
+	retrieval.alice_bytes = S * shape.response_ciphertexts * profile.response_ciphertext_bytes;
+	retrieval.rounds = 3;
+	// Shards work in parallel, each over its own rows
+	double shard_rows = (double)shape.db_size / shape.num_shards;
+	retrieval.ms += shard_rows * profile.pir_setup_ns_per_row / 1e6;
+	retrieval.ms += shard_rows * shape.num_hash * profile.pir_answer_ns_per_row / profile.num_threads / 1e6;
+
+	// The linear scan picks the matching index among the w slots of every bucket
+	PhaseCost decode{"Decode"};
+	decode.ot_bits = bucket_comparators;
+	decode.and_gates = (query_bits + entry_bits) * bucket_comparators + B * num_slots * (query_bits + entry_bits);
+	decode.rounds = 1;
+
+	PhaseCost mapping{"Mapping"};
+	mapping.and_gates = entry_bits * (n - 1) + entry_bits * batch_comparators;
+
+	std::vector<PhaseCost> phases{dedup, oprf, retrieval, decode, mapping};
+	for (auto& phase : phases) {
+		add_gc_traffic(phase);
+		add_time(phase, profile);
+	}
+
+	if (shape.fuse) {
+		// The bucket sort overlaps the PIR answer, which dominates it
+		auto& fused = phases[2];
+		fused.phase = "Share Retrieval + Decode";
+		fused.and_gates += decode.and_gates;
+		fused.ot_bits += decode.ot_bits;
+		fused.alice_bytes += decode.alice_bytes;
+		fused.bob_bytes += decode.bob_bytes;
+		fused.ms += decode.ms - decode.rounds * profile.rtt_ms;
+		phases.erase(phases.begin() + 3);
+	}
+	return phases;
+}
+
+std::vector<PhaseCost> predict_splut_cost(const SPLUTShape& shape, const CostProfile& profile) {
+	uint64_t n = shape.batch_size, l_in = shape.l_in, l_out = shape.l_out;
+	uint64_t lut_size = 1ULL << l_in;
+
+	// The queries' label bits are their XOR shares, so the input conversion is free
+	PhaseCost input{"Input Conversion"};
+
+	// Silent OT traffic is sublinear in the number of OTs, so only its rounds are counted
+	PhaseCost setup{"Setup Phase"};
+	setup.rounds = 3;
+	setup.ms = n * l_in / profile.silent_ots_per_s * 1e3;
+
+	// BOB sends his masked queries, ALICE the whole masked table of every query. 
+	// Every entry takes one AES call per input bit to derive its mask. 
+	PhaseCost online{"Online Phase"};
+	online.bob_bytes = n * sizeof(uint32_t);
+	online.alice_bytes = (n * lut_size * l_out + 7) / 8;
+	online.rounds = 1;
+	online.ms = (double)n * lut_size * l_in / (profile.aes_blocks_per_s * profile.num_threads) * 1e3;
+
+	PhaseCost output{"Output Conversion"};
+	if (shape.gc_outputs) {
+		output.garbler_input_bits = n * l_out;
+		output.ot_bits = n * l_out;
+	}
+
+	std::vector<PhaseCost> phases{input, setup, online, output};
+	for (auto& phase : phases) {
+		add_gc_traffic(phase);
+		add_time(phase, profile);
+	}
+	return phases;
+}
+
+// The fields of a profile file, in the order save_cost_profile writes them
+static std::vector<std::pair<std::string, double CostProfile::*>> profile_fields() {
+	return {
+		{"bandwidth_mbps", &CostProfile::bandwidth_mbps},
+		{"rtt_ms", &CostProfile::rtt_ms},
+		{"and_gates_per_s", &CostProfile::and_gates_per_s},
+		{"ots_per_s", &CostProfile::ots_per_s},
+		{"query_ciphertext_bytes", &CostProfile::query_ciphertext_bytes},
+		{"response_ciphertext_bytes", &CostProfile::response_ciphertext_bytes},
+		{"pir_setup_ns_per_row", &CostProfile::pir_setup_ns_per_row},
+		{"pir_answer_ns_per_row", &CostProfile::pir_answer_ns_per_row},
+		{"silent_ots_per_s", &CostProfile::silent_ots_per_s},
+		{"aes_blocks_per_s", &CostProfile::aes_blocks_per_s},
+	};
+}
+
+CostProfile load_cost_profile(const std::string& filename, const CostProfile& base) {
+	std::ifstream in(filename);
+	utils::check(in.is_open(), fmt::format("[Cost model] Cannot open the profile {}. ", filename));
+	auto fields = profile_fields();
+	CostProfile profile = base;
+	std::string line;
+	for (int line_no = 1; std::getline(in, line); line_no++) {
+		std::istringstream words(line.substr(0, line.find('#')));
+		std::string name;
+		double value;
+		if (!(words >> name))
+			continue;
+		auto field = std::find_if(fields.begin(), fields.end(), [&](auto& field) { return field.first == name; });
+		utils::check(field != fields.end(), fmt::format("[Cost model] {}:{}: unknown field {}. ", filename, line_no, name));
+		utils::check(words >> value && value > 0, fmt::format("[Cost model] {}:{}: {} needs a positive value. ", filename, line_no, name));
+		profile.*(field->second) = value;
+	}
+	return profile;
+}
+
+void save_cost_profile(const std::string& filename, const CostProfile& profile) {
+	std::ofstream out(filename);
+	utils::check(out.is_open(), fmt::format("[Cost model] Cannot write the profile {}. ", filename));
+	for (auto& [name, field] : profile_fields())
+		out << fmt::format("{} {}", name, profile.*field) << std::endl;
+}
+
+// Wall time of a GC span minus the time the link accounts for: the traffic implied by its gate counters, and rounds
+static double compute_ms(const recordinfo& record, uint64_t rounds, const CostProfile& profile) {
+	auto counter = [&](std::string name) { return record.counters.count(name) ? record.counters.at(name) : 0; };
+	PhaseCost cost{record.tag};
+	cost.and_gates = counter("and_gates");
+	cost.ot_bits = counter("ot_bits");
+	cost.garbler_input_bits = counter("garbler_input_bits");
+	cost.revealed_bits = counter("revealed_bits");
+	add_gc_traffic(cost);
+	return record.wall_ms - (cost.alice_bytes + cost.bob_bytes) * 8 / (profile.bandwidth_mbps * 1e3) - rounds * profile.rtt_ms;
+}
+
+CostProfile calibrate_cost_profile(const FABLEShape& shape, const std::vector<recordinfo>& records, int party, CostProfile profile) {
+	std::map<std::string, uint64_t> rounds{{"Share Conversion", 1}};
+	for (auto& phase : predict_fable_cost(shape, profile))
+		rounds[phase.phase] = phase.rounds;
+
+	// Sums over every lookup in the records; in a fused lookup, the PIR spans nest one level deeper
+	double gc_ms = 0, ot_ms = 0, setup_ms = 0, answer_ms = 0;
+	uint64_t and_gates = 0, ot_bits = 0, num_setups = 0, num_answers = 0;
+	uint64_t query_bytes = 0, query_ciphertexts = 0, response_bytes = 0, response_ciphertexts = 0;
+	for (auto& record : records) {
+		if (record.path.rfind("FABLE Execution/", 0) != 0)
+			continue;
+		auto counter = [&](std::string name) { return record.counters.count(name) ? record.counters.at(name) : 0; };
+		if (record.tag == "Deduplicate" || record.tag == "OPRF Evaluation" || record.tag == "Mapping") {
+			gc_ms += compute_ms(record, rounds[record.tag], profile);
+			and_gates += counter("and_gates");
+		} else if (record.tag == "Share Conversion") {
+			ot_ms += compute_ms(record, rounds[record.tag], profile);
+			ot_bits += counter("ot_bits");
+		} else if (record.tag == "Server Setup") {
+			setup_ms += record.wall_ms;
+			num_setups++;
+		} else if (record.tag == "Answer Computation") {
+			answer_ms += record.wall_ms;
+			num_answers++;
+		} else if (record.tag == "Query Communication" && party == BOB) {
+			query_bytes += record.bytes_sent;
+			query_ciphertexts += counter("he_query_ciphertexts");
+		} else if (record.tag == "Answer Communication" && party == ALICE) {
+			response_bytes += record.bytes_sent;
+			response_ciphertexts += counter("he_response_ciphertexts");
+		}
+	}
+
+	// Shards work in parallel, each over its own rows, as in predict_fable_cost
+	double shard_rows = (double)shape.db_size / shape.num_shards;
+	if (and_gates > 0 && gc_ms > 0)
+		profile.and_gates_per_s = and_gates / gc_ms * 1e3;
+	if (ot_bits > 0 && ot_ms > 0)
+		profile.ots_per_s = ot_bits / ot_ms * 1e3;
+	if (num_setups > 0 && setup_ms > 0)
+		profile.pir_setup_ns_per_row = setup_ms / num_setups * 1e6 / shard_rows;
+	if (num_answers > 0 && answer_ms > 0)
+		profile.pir_answer_ns_per_row = answer_ms / num_answers * 1e6 * profile.num_threads / (shard_rows * shape.num_hash);
+	if (query_ciphertexts > 0)
+		profile.query_ciphertext_bytes = (double)query_bytes / query_ciphertexts;
+	if (response_ciphertexts > 0)
+		profile.response_ciphertext_bytes = (double)response_bytes / response_ciphertexts;
+	return profile;
+}
+
+PhaseCost total_cost(const std::vector<PhaseCost>& phases) {
+	PhaseCost total{"Total"};
+	for (auto& phase : phases) {
+		total.and_gates += phase.and_gates;
+		total.ot_bits += phase.ot_bits;
+		total.garbler_input_bits += phase.garbler_input_bits;
+		total.revealed_bits += phase.revealed_bits;
+		total.he_ciphertexts += phase.he_ciphertexts;
+		total.alice_bytes += phase.alice_bytes;
+		total.bob_bytes += phase.bob_bytes;
+		total.rounds += phase.rounds;
+		total.ms += phase.ms;
+	}
+	return total;
+}
+
+} // namespace sci
@@ -0,0 +1,95 @@
+#ifndef FABLE_COST_MODEL_H__
+#define FABLE_COST_MODEL_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "batchpirserver.h"
+
+struct recordinfo;
+
+namespace sci {
+
+// Everything the FABLE circuits and PIR messages depend on
+struct FABLEShape {
+	uint64_t batch_size;
+	uint64_t num_buckets; // per shard
+	uint64_t db_size;
+	int num_shards;
+	int hash_type;
+	bool fuse;
+	int index_bits;   // DatabaseConstants::InputLength
+	int entry_bits;   // LUT_OUTPUT_SIZE
+	int num_hash;     // DatabaseConstants::NumHashFunctions
+	uint64_t query_ciphertexts;    // per shard
+	uint64_t response_ciphertexts; // per shard
+};
+
+// params must describe a single shard, as built by fable_prepare; batch_size is that of the whole lookup
+FABLEShape fable_shape(BatchPirParams* params, uint64_t batch_size, uint64_t db_size, int num_shards, bool fuse);
+
+// Machine and network constants. The defaults are rough figures for one core of a recent x86 server; 
+// calibrate them with the measured phases of bench_fable (calib=<file>) and load them back with load_cost_profile. 
+struct CostProfile {
+	double bandwidth_mbps = 1000;
+	double rtt_ms = 0.1;
+	double and_gates_per_s = 15e6;
+	double ots_per_s = 20e6;
+	double query_ciphertext_bytes = 110e3;
+	double response_ciphertext_bytes = 110e3;
+	double pir_setup_ns_per_row = 1000;  // OPRF hashing and encoding of the bucket databases
+	double pir_answer_ns_per_row = 300;
+	double silent_ots_per_s = 10e6;      // SPLUT+ setup
+	double aes_blocks_per_s = 100e6;     // SPLUT+ mask derivation, per thread
+	int num_threads = 1;                 // threads answering the PIR queries of one shard, or deriving the SPLUT+ masks
+};
+
+// A profile file holds one "name value" line per field of CostProfile but num_threads, which belongs to the run rather
+// than the machine. '#' starts a comment, and fields left out keep their value in base. 
+CostProfile load_cost_profile(const std::string& filename, const CostProfile& base = CostProfile());
+void save_cost_profile(const std::string& filename, const CostProfile& profile);
+
+// Replaces the machine constants of profile with the ones measured by the spans of a FABLE lookup (engine 0) at this
+// party: the AND gate rate from Deduplicate, OPRF Evaluation and Mapping, the OT rate from Share Conversion, the PIR
+// rates from Server Setup and Answer Computation (ALICE), and the size of the ciphertexts this party sent. 
+// The bandwidth and rtt of profile must describe the link the spans ran over, since the time the link accounts for is
+// taken off every GC span. Constants whose spans are missing, or whose time is all spent on the link, are kept. 
+CostProfile calibrate_cost_profile(const FABLEShape& shape, const std::vector<recordinfo>& records, int party, CostProfile profile);
+
+// Predicted cost of one phase. Bytes are split by sender, since NetIO only counts sent bytes. 
+struct PhaseCost {
+	std::string phase;
+	uint64_t and_gates = 0;
+	uint64_t ot_bits = 0;
+	uint64_t garbler_input_bits = 0;
+	uint64_t revealed_bits = 0;
+	uint64_t he_ciphertexts = 0;
+	uint64_t alice_bytes = 0;
+	uint64_t bob_bytes = 0;
+	uint64_t rounds = 0;
+	double ms = 0;
+};
+
+// Number of compare-and-swap steps of the bitonic sorter in sort.h on n elements
+uint64_t bitonic_comparators(uint64_t n);
+
+// One entry per phase of fable_lookup (or fable_lookup_fuse), named as their records
+std::vector<PhaseCost> predict_fable_cost(const FABLEShape& shape, const CostProfile& profile = CostProfile());
+
+// A batch of batch_size lookups into a LUT of 2^l_in entries of l_out bits
+struct SPLUTShape {
+	uint64_t batch_size;
+	int l_in;
+	int l_out;
+	bool gc_outputs = true; // the results are fed back as GC labels, rather than kept as XOR shares
+};
+
+// One entry per phase of a SPLUT+ lookup in lookup(), named as the records of lookup() and SPLUT: 
+// the queries are converted to XOR shares, looked up, and the results fed back as GC labels if needed. 
+std::vector<PhaseCost> predict_splut_cost(const SPLUTShape& shape, const CostProfile& profile = CostProfile());
+
+// Sum of all phases
+PhaseCost total_cost(const std::vector<PhaseCost>& phases);
+
+} // namespace sci
+#endif
@@ -0,0 +1,22 @@
+#include "gate_counter.h"
+#include "pir_channel.h"
+#include "utils/io_utils.h"
+
+namespace sci {
+
+void install_counters() {
+	auto circuit = new CountingCircuitExecution(circ_exec);
+	circ_exec = circuit;
+	auto protocol = new CountingProtocolExecution(prot_exec);
+	prot_exec = protocol;
+	register_counter("and_gates", [circuit]() { return circuit->and_gates(); });
+	register_counter("xor_gates", [circuit]() { return circuit->xor_gates(); });
+	register_counter("ot_bits", [protocol]() { return protocol->ots(); });
+	register_counter("garbler_input_bits", [protocol]() { return protocol->garbler_inputs(); });
+	register_counter("revealed_bits", [protocol]() { return protocol->revealed(); });
+	register_counter("he_query_ciphertexts", pir_query_ciphertexts);
+	register_counter("he_response_ciphertexts", pir_response_ciphertexts);
+	register_counter("he_compression_saved_bytes", pir_compression_saved_bytes);
+}
+
+} // namespace sci
@@ -0,0 +1,74 @@
+#ifndef FABLE_GATE_COUNTER_H__
+#define FABLE_GATE_COUNTER_H__
+
+#include "GC/circuit_execution.h"
+#include "GC/protocol_execution.h"
+#include <atomic>
+#include <cstdint>
+
+namespace sci {
+
+// Forwards every gate to the wrapped circuit execution and counts the AND and XOR gates. 
+// The profiler snapshots the counters from whichever thread opens or closes a span (e.g. the "Key Transfer" thread of
+// the lookup), so they are relaxed atomics: the counts are exact, and no ordering with the gates is needed. 
+class CountingCircuitExecution : public CircuitExecution {
+public:
+	explicit CountingCircuitExecution(CircuitExecution* inner) : inner(inner) {}
+
+	block128 and_gate(const block128& in1, const block128& in2) override {
+		num_and_gates.fetch_add(1, std::memory_order_relaxed);
+		return inner->and_gate(in1, in2);
+	}
+	block128 xor_gate(const block128& in1, const block128& in2) override {
+		num_xor_gates.fetch_add(1, std::memory_order_relaxed);
+		return inner->xor_gate(in1, in2);
+	}
+	block128 not_gate(const block128& in1) override { return inner->not_gate(in1); }
+	block128 public_label(bool b) override { return inner->public_label(b); }
+
+	uint64_t and_gates() const { return num_and_gates.load(std::memory_order_relaxed); }
+	uint64_t xor_gates() const { return num_xor_gates.load(std::memory_order_relaxed); }
+
+private:
+	CircuitExecution* inner;
+	std::atomic<uint64_t> num_and_gates{0};
+	std::atomic<uint64_t> num_xor_gates{0};
+};
+
+// Forwards input and output wires to the wrapped protocol execution. Every bit fed by BOB is transferred by one
+// correlated OT, and every revealed bit costs one decoding bit from the garbler. The counters are relaxed atomics for
+// the same reason as above. 
+class CountingProtocolExecution : public ProtocolExecution {
+public:
+	explicit CountingProtocolExecution(ProtocolExecution* inner) : ProtocolExecution(inner->cur_party), inner(inner) {}
+
+	void feed(block128* lbls, int party, const bool* b, int nel) override {
+		if (party == BOB)
+			num_ots.fetch_add(nel, std::memory_order_relaxed);
+		else
+			num_garbler_inputs.fetch_add(nel, std::memory_order_relaxed);
+		inner->feed(lbls, party, b, nel);
+	}
+	void reveal(bool* out, int party, const block128* lbls, int nel) override {
+		num_revealed.fetch_add(nel, std::memory_order_relaxed);
+		inner->reveal(out, party, lbls, nel);
+	}
+	void finalize() override { inner->finalize(); }
+
+	uint64_t ots() const { return num_ots.load(std::memory_order_relaxed); }
+	uint64_t garbler_inputs() const { return num_garbler_inputs.load(std::memory_order_relaxed); }
+	uint64_t revealed() const { return num_revealed.load(std::memory_order_relaxed); }
+
+private:
+	ProtocolExecution* inner;
+	std::atomic<uint64_t> num_ots{0};
+	std::atomic<uint64_t> num_garbler_inputs{0};
+	std::atomic<uint64_t> num_revealed{0};
+};
+
+// Wraps circ_exec and prot_exec (call after setup_semi_honest) and registers their counters with the profiler, 
+// together with the number of PIR query and response ciphertexts (see pir_channel.h)
+void install_counters();
+
+} // namespace sci
+#endif
@@ -0,0 +1,137 @@
+#include "hybrid.h"
+#include "conversion.h"
+#include <cmath>
+
+namespace sci {
+
+// SPLUT+ queries are uint32_t
+const int SPLUT_MAX_INPUT_BITS = 32;
+const int SPLUT_MAX_OUTPUT_BITS = 64;
+
+static const char* engine_name(LookupEngine engine) {
+	return engine == LookupEngine::splut ? "SPLUT+" : "FABLE";
+}
+
+static int index_bits(uint64_t db_size) {
+	int l_in = 1;
+	while (l_in < 64 && (1ULL << l_in) < db_size)
+		l_in++;
+	return l_in;
+}
+
+LookupPlan plan_lookup(uint64_t db_size, int batch_size, const LookupOptions& opts, bool xor_shared) {
+	LookupPlan plan{opts.engine, index_bits(db_size), INFINITY, INFINITY};
+	CostProfile profile = opts.profile;
+	profile.num_threads = opts.parallel ? opts.num_threads : 1;
+
+	if (plan.l_in <= DatabaseConstants::InputLength && opts.l_out <= LUT_OUTPUT_SIZE) {
+		int num_shards = opts.shard_opts.num_shards;
+		BatchPirParams params(shard_batch_size(batch_size, num_shards), (db_size + num_shards - 1) / num_shards, opts.parallel, opts.num_threads, (BatchPirType)opts.type, (HashType)opts.hash_type);
+		plan.fable_ms = total_cost(predict_fable_cost(fable_shape(&params, batch_size, db_size, num_shards, opts.fuse), profile)).ms;
+	}
+	if (opts.splut_chl && plan.l_in <= SPLUT_MAX_INPUT_BITS && opts.l_out <= SPLUT_MAX_OUTPUT_BITS)
+		plan.splut_ms = total_cost(predict_splut_cost(SPLUTShape{(uint64_t)batch_size, plan.l_in, opts.l_out, !xor_shared}, profile)).ms;
+
+	if (plan.engine == LookupEngine::automatic)
+		plan.engine = plan.splut_ms < plan.fable_ms ? LookupEngine::splut : LookupEngine::fable;
+	double ms = plan.engine == LookupEngine::splut ? plan.splut_ms : plan.fable_ms;
+	utils::check(std::isfinite(ms), fmt::format("[Lookup] {} cannot look up {}-bit inputs and {}-bit outputs{}. ",
+		engine_name(plan.engine), plan.l_in, opts.l_out, plan.engine == LookupEngine::splut && !opts.splut_chl ? " without a SPLUT+ channel" : ""));
+	return plan;
+}
+
+// SPLUT+ on XOR shares of the queries' low l_in bits; returns XOR shares of the l_out-bit results
+static vector<uint64_t> run_splut(vector<uint64_t>& lut, const vector<uint64_t>& query_shares, int l_in, int party, const LookupOptions& opts) {
+	vector<uint32_t> x(query_shares.size());
+	for (size_t i = 0; i < x.size(); i++)
+		x[i] = query_shares[i] & ((1ULL << l_in) - 1);
+
+	// SPLUT+ reads all 2^l_in entries, so a LUT whose size is not a power of two is padded with zeros
+	vector<uint64_t> padded;
+	auto table = &lut;
+	if (party == ALICE && lut.size() < (1ULL << l_in)) {
+		padded = lut;
+		padded.resize(1ULL << l_in, 0);
+		table = &padded;
+	}
+	uint64_t num_threads = opts.parallel ? opts.num_threads : 1;
+	if (opts.l_out <= 32) {
+		auto z = SPLUT(*table, x, opts.l_out, l_in, party, *opts.splut_chl, num_threads);
+		return vector<uint64_t>(z.begin(), z.end());
+	}
+	return SPLUT_wide<uint64_t>(*table, x, opts.l_out, l_in, party, *opts.splut_chl, num_threads);
+}
+
+// FABLE on GC queries of at least l_in bits; returns l_out-bit results
+static IntegerArray run_fable(vector<uint64_t>& lut, IntegerArray& secret_queries, int l_in, int party, NetIO* io_gc, const LookupOptions& opts, bool verbose) {
+	// Only the low l_in bits address the LUT. FABLE's queries carry one bit more than the LUT index, 
+	// so that deduplicated slots can hold dummies.
+	for (auto& query : secret_queries) {
+		query.bits.resize(l_in);
+		query.bits.resize(DatabaseConstants::InputLength + 1, Bit(0));
+	}
+
+	start_record(io_gc, "FABLE Preparation");
+	auto lut_params = fable_prepare(lut, party, secret_queries.size(), lut.size(), opts.parallel, opts.num_threads, opts.type, opts.hash_type, io_gc, opts.shard_opts);
+	end_record(io_gc, "FABLE Preparation", verbose);
+
+	auto result = opts.fuse ? fable_lookup_fuse(secret_queries, lut_params, verbose) : fable_lookup(secret_queries, lut_params, verbose);
+	for (auto& entry : result)
+		entry.bits.resize(opts.l_out);
+	return result;
+}
+
+// Both parties follow ALICE's plan, even if their profiles differ
+static LookupPlan agree_plan(uint64_t db_size, int batch_size, bool xor_shared, int party, NetIO* io_gc, const LookupOptions& opts, bool verbose) {
+	auto plan = plan_lookup(db_size, batch_size, opts, xor_shared);
+	int engine = (int)plan.engine;
+	if (party == ALICE) {
+		io_gc->send_data(&engine, sizeof(int));
+		io_gc->flush();
+	} else {
+		io_gc->recv_data(&engine, sizeof(int));
+		plan.engine = (LookupEngine)engine;
+		utils::check(plan.engine == LookupEngine::fable || opts.splut_chl, "[Lookup] ALICE picked SPLUT+, but BOB has no SPLUT+ channel. ");
+	}
+	if (verbose)
+		cout << fmt::format("Lookup plan: FABLE {:.1f} ms, SPLUT+ {:.1f} ms; running {}. ", plan.fable_ms, plan.splut_ms, engine_name(plan.engine)) << endl;
+	return plan;
+}
+
+IntegerArray lookup(vector<uint64_t>& lut, IntegerArray secret_queries, int party, NetIO* io_gc, const LookupOptions& opts, bool verbose) {
+	auto plan = agree_plan(lut.size(), secret_queries.size(), false, party, io_gc, opts, verbose);
+	for (auto& query : secret_queries)
+		utils::check(query.size() >= plan.l_in, fmt::format("[Lookup] Queries of {} bits cannot address {} entries. ", query.size(), lut.size()));
+
+	if (plan.engine == LookupEngine::fable)
+		return run_fable(lut, secret_queries, plan.l_in, party, io_gc, opts, verbose);
+
+	start_record(io_gc, "Input Conversion");
+	for (auto& query : secret_queries)
+		query.bits.resize(plan.l_in);
+	auto query_shares = to_xor_shares(secret_queries);
+	end_record(io_gc, "Input Conversion", verbose);
+
+	auto result_shares = run_splut(lut, query_shares, plan.l_in, party, opts);
+
+	start_record(io_gc, "Output Conversion");
+	auto result = from_xor_shares(result_shares, opts.l_out, party);
+	end_record(io_gc, "Output Conversion", verbose);
+	return result;
+}
+
+vector<uint64_t> lookup(vector<uint64_t>& lut, const vector<uint64_t>& query_shares, int party, NetIO* io_gc, const LookupOptions& opts, bool verbose) {
+	utils::check(opts.l_out <= 64, fmt::format("[Lookup] Results of {} bits do not fit in XOR-shared words. ", opts.l_out));
+	auto plan = agree_plan(lut.size(), query_shares.size(), true, party, io_gc, opts, verbose);
+	if (plan.engine == LookupEngine::splut)
+		return run_splut(lut, query_shares, plan.l_in, party, opts);
+
+	start_record(io_gc, "Input Sharing");
+	auto secret_queries = from_xor_shares(query_shares, plan.l_in, party);
+	end_record(io_gc, "Input Sharing", verbose);
+
+	auto result = run_fable(lut, secret_queries, plan.l_in, party, io_gc, opts, verbose);
+	return to_xor_shares(result);
+}
+
+} // namespace sci
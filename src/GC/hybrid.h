@@ -0,0 +1,50 @@
+#ifndef FABLE_HYBRID_H__
+#define FABLE_HYBRID_H__
+
+#include "lookup.h"
+#include "cost_model.h"
+#include "OT/splut.h"
+
+namespace sci {
+
+// The SPLUT+ channel of lookup() connects to port + SPLUT_PORT_OFFSET
+const int SPLUT_PORT_OFFSET = 300;
+
+enum class LookupEngine { fable = 0, splut = 1, automatic = 2 };
+
+struct LookupOptions {
+	LookupEngine engine = LookupEngine::automatic;
+	coproto::AsioSocket* splut_chl = nullptr; // SPLUT+ runs over its own socket; nullptr = FABLE only
+	int l_out = LUT_OUTPUT_SIZE;
+	bool parallel = true;
+	int num_threads = 1;
+	int type = 0;       // FABLE's PIR: 0 = PIRANA; 1 = UIUC
+	int hash_type = 0;  // FABLE's OPRF: 0 = LowMC; 1 = AES
+	bool fuse = false;
+	ShardOptions shard_opts = ShardOptions();
+	CostProfile profile = CostProfile();
+};
+
+// Predicted latency of both engines; an engine that cannot serve the lookup is predicted at infinity
+struct LookupPlan {
+	LookupEngine engine;
+	int l_in;
+	double fable_ms, splut_ms;
+};
+
+// Picks the cheaper engine for batch_size lookups into a LUT of db_size entries, unless opts.engine forces one.
+// With xor_shared, queries and results are XOR shares rather than GC values.
+LookupPlan plan_lookup(uint64_t db_size, int batch_size, const LookupOptions& opts, bool xor_shared = false);
+
+// Looks up secret_queries in the LUT with the engine picked by plan_lookup, and returns l_out-bit results.
+// ALICE's plan is followed by both parties. Queries and results are GC Integers either way: for SPLUT+, the queries are
+// converted to XOR shares of their low l_in = ceil(log2(lut.size())) bits, and the XOR-shared results are fed back into the circuit.
+// As for fable_prepare, only ALICE's LUT entries are read, but both parties must pass LUTs of the same size and the same batch size.
+IntegerArray lookup(vector<uint64_t>& lut, IntegerArray secret_queries, int party, NetIO* io_gc, const LookupOptions& opts, bool verbose = false);
+
+// The same for XOR-shared query words and results (l_out <= 64). SPLUT+ then runs on the shares directly, without GC;
+// FABLE feeds the shares into the circuit, one feed per party, and returns the results' label bits as shares.
+vector<uint64_t> lookup(vector<uint64_t>& lut, const vector<uint64_t>& query_shares, int party, NetIO* io_gc, const LookupOptions& opts, bool verbose = false);
+
+} // namespace sci
+#endif
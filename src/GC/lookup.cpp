@@ -1,201 +1,197 @@
 #include "lookup.h"
+#include "conversion.h"
+#include "share.h"
+#include "utils/numa_utils.h"
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <type_traits>
 
 namespace sci {
 
-FABLEParams fable_prepare(vector<uint64_t>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, int type, int hash_type, NetIO *io_gc) {
-
-	auto params = new BatchPirParams(batch_size, lut.size(), parallel, num_threads, (BatchPirType)type, (HashType)hash_type);
-
-	auto config = new FABLEConfig{
-		params->get_batch_size(), 
-		params->get_bucket_size(), 
-		(1ULL << LUT_INPUT_SIZE), 
-		LUT_INPUT_SIZE
-	};
+// Affinity and memory policy are per thread, so the calling thread and every thread of the OpenMP pool bind
+// themselves; threads created afterwards (e.g. the key transfer thread, or a larger pool) inherit the binding
+static void bind_threads(int node) {
+	bool bound = true;
+	#pragma omp parallel reduction(&&: bound)
+	{
+		bound = numa_bind_node(node);
+	}
+	utils::check(bound, fmt::format("[FABLE] Failed to bind to NUMA node {}. ", node));
+}
 
-	BatchPIRServer* batch_server; 
-	BatchPIRClient* batch_client;
-	
-    osuCrypto::PRNG* prng = new osuCrypto::PRNG(osuCrypto::sysRandomSeed());
+template<typename LUT>
+static FABLEParams prepare(LUT& lut, int party, int batch_size, uint64_t db_size, bool parallel, int num_threads, BatchPirType type, HashType hash_type, NetIO *io_gc, ShardOptions shard_opts) {
 
+	// BOB's parameters describe a single shard, so both parties must agree on the number of shards
+	int num_shards = shard_opts.num_shards;
 	if (party == BOB) {
-		batch_client = new BatchPIRClient(*params);
-		auto [glk_buffer, rlk_buffer] = batch_client->get_public_keys();
-
-		// send key_buf and query_buf
-		uint32_t glk_size = glk_buffer.size(), rlk_size = rlk_buffer.size();
-		io_gc->send_data(&glk_size, sizeof(uint32_t));
-		io_gc->send_data(&rlk_size, sizeof(uint32_t));
-		io_gc->send_data(glk_buffer.data(), glk_size);
-		io_gc->send_data(rlk_buffer.data(), rlk_size);
+		io_gc->send_data(&num_shards, sizeof(int));
 	} else {
-		batch_server = new BatchPIRServer(*params, *prng);
-		batch_server->populate_raw_db(lut);
-		uint32_t glk_size, rlk_size;
-		io_gc->recv_data(&glk_size, sizeof(uint32_t));
-		io_gc->recv_data(&rlk_size, sizeof(uint32_t));
-		vector<seal::seal_byte> glk_buffer(glk_size), rlk_buffer(rlk_size);
-		io_gc->recv_data(glk_buffer.data(), glk_size);
-		io_gc->recv_data(rlk_buffer.data(), rlk_size);
-		batch_server->set_client_keys(client_id, {glk_buffer, rlk_buffer});
+		int client_num_shards;
+		io_gc->recv_data(&client_num_shards, sizeof(int));
+		utils::check(client_num_shards == num_shards, "[FABLE] Both parties must use the same number of shards. ");
 	}
-	
-	auto lut_params = FABLEParams{
-		party, 
-		hash_type, 
-		batch_size, 
-		config, 
-		prng, 
-		params,  
-		batch_server, 
-		batch_client, 
-		io_gc
-	};
 
-	return lut_params; 
-}
+    osuCrypto::PRNG* prng = new osuCrypto::PRNG(osuCrypto::sysRandomSeed());
 
-FABLEParams fable_prepare(map<uint64_t, uint64_t>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, int type, int hash_type, NetIO *io_gc) {
+	// Each shard answers the queries routed to its rows (see ShardRouter), so both parties build the parameters of one
+	// shard: shard_batch_size queries into the rows of the largest shard, which only ALICE can count
+	uint64_t shard_db_size = db_size;
+	std::unique_ptr<ShardRouter> router;
+	if (num_shards > 1 && party == ALICE) {
+		if constexpr (std::is_same_v<LUT, map<uint64_t, rawdatablock>>) {
+			utils::check(false, "[FABLE] Sharding supports integer LUTs only. ");
+		} else {
+			router = std::make_unique<ShardRouter>(prng->get<oc::block>(), num_shards);
+			auto rows = router->count(lut);
+			shard_db_size = *std::max_element(rows.begin(), rows.end());
+			io_gc->send_data(&shard_db_size, sizeof(uint64_t));
+			io_gc->flush();
+		}
+	} else if (num_shards > 1) {
+		io_gc->recv_data(&shard_db_size, sizeof(uint64_t));
+	}
 
-	auto params = new BatchPirParams(batch_size, lut.size(), parallel, num_threads, (BatchPirType)type, (HashType)hash_type);
+	auto params = new BatchPirParams(shard_batch_size(batch_size, num_shards), shard_db_size, parallel, num_threads, type, hash_type);
 
 	auto config = new FABLEConfig{
-		params->get_batch_size(), 
-		params->get_bucket_size(), 
-		(1ULL << LUT_INPUT_SIZE), 
+		(uint64_t)batch_size,
+		params->get_bucket_size(),
+		(1ULL << LUT_INPUT_SIZE),
 		LUT_INPUT_SIZE
 	};
 
-	BatchPIRServer* batch_server; 
-	BatchPIRClient* batch_client;
-	
-    osuCrypto::PRNG* prng = new osuCrypto::PRNG(osuCrypto::sysRandomSeed());
+	BatchPIRServer* batch_server = nullptr;
+	BatchPIRClient* batch_client = nullptr;
+	PIRShardCoordinator* shards = nullptr;
 
 	if (party == BOB) {
 		batch_client = new BatchPIRClient(*params);
 		auto [glk_buffer, rlk_buffer] = batch_client->get_public_keys();
 
-		// send key_buf and query_buf
-		uint32_t glk_size = glk_buffer.size(), rlk_size = rlk_buffer.size();
-		io_gc->send_data(&glk_size, sizeof(uint32_t));
-		io_gc->send_data(&rlk_size, sizeof(uint32_t));
-		io_gc->send_data(glk_buffer.data(), glk_size);
-		io_gc->send_data(rlk_buffer.data(), rlk_size);
+		send_bytes(io_gc, glk_buffer);
+		send_bytes(io_gc, rlk_buffer);
+		io_gc->flush();
 	} else {
-		batch_server = new BatchPIRServer(*params, *prng);
-		batch_server->populate_raw_db(lut);
-		uint32_t glk_size, rlk_size;
-		io_gc->recv_data(&glk_size, sizeof(uint32_t));
-		io_gc->recv_data(&rlk_size, sizeof(uint32_t));
-		vector<seal::seal_byte> glk_buffer(glk_size), rlk_buffer(rlk_size);
-		io_gc->recv_data(glk_buffer.data(), glk_size);
-		io_gc->recv_data(rlk_buffer.data(), rlk_size);
-		batch_server->set_client_keys(client_id, {glk_buffer, rlk_buffer});
+		// The keys do not depend on the LUT, so they are received while the database is encoded; 
+		// otherwise BOB's send would stall until the encoding is done
+		vector<seal::seal_byte> glk_buffer, rlk_buffer;
+		double key_ms = 0;
+		std::thread key_thread([&]() {
+			start_record(io_gc, "Key Transfer");
+			auto key_start = clock_start();
+			glk_buffer = recv_bytes(io_gc);
+			rlk_buffer = recv_bytes(io_gc);
+			key_ms = time_from(key_start) / 1000;
+			end_record(io_gc, "Key Transfer");
+		});
+
+		start_record("Database Encoding");
+		auto encode_start = clock_start();
+		if (num_shards > 1) {
+			if constexpr (!std::is_same_v<LUT, map<uint64_t, rawdatablock>>) {
+				shards = new PIRShardCoordinator(shard_opts, params, ShardSpec{
+					shard_batch_size(batch_size, num_shards), shard_db_size, 0, parallel, num_threads, (int32_t)type, (int32_t)hash_type
+				}, *router);
+				shards->populate(lut);
+			}
+		} else {
+			// Without workers, the in-process server (and the rest of ALICE) runs on the first online node
+			if (shard_opts.numa)
+				bind_threads(numa_online_nodes().front());
+			batch_server = new BatchPIRServer(*params, *prng);
+			batch_server->populate_raw_db(lut);
+		}
+		double encode_ms = time_from(encode_start) / 1000;
+		end_record("Database Encoding");
+
+		key_thread.join();
+		cout << fmt::format("Preparation: max(encode = {:.1f} ms, key transfer = {:.1f} ms) = {:.1f} ms. ", encode_ms, key_ms, std::max(encode_ms, key_ms)) << endl;
+		if (shards) {
+			shards->set_client_keys(glk_buffer, rlk_buffer);
+		} else {
+			batch_server->set_client_keys(client_id, {glk_buffer, rlk_buffer});
+		}
 	}
-	
+
 	auto lut_params = FABLEParams{
-		party, 
-		hash_type, 
-		batch_size, 
-		config, 
-		prng, 
-		params,  
-		batch_server, 
-		batch_client, 
-		io_gc
+		party,
+		(int)hash_type,
+		batch_size,
+		config,
+		prng,
+		params,
+		batch_server,
+		batch_client,
+		io_gc,
+		num_shards,
+		shards
 	};
 
-	return lut_params; 
+	return lut_params;
 }
 
-FABLEParams fable_prepare(map<uint64_t, rawdatablock>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, BatchPirType type, HashType hash_type, NetIO *io_gc) {
+FABLEParams fable_prepare(vector<uint64_t>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, int type, int hash_type, NetIO *io_gc, ShardOptions shard_opts) {
+	return prepare(lut, party, batch_size, lut.size(), parallel, num_threads, (BatchPirType)type, (HashType)hash_type, io_gc, shard_opts);
+}
 
-	auto params = new BatchPirParams(batch_size, db_size, parallel, num_threads, type, hash_type);
+FABLEParams fable_prepare(map<uint64_t, uint64_t>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, int type, int hash_type, NetIO *io_gc, ShardOptions shard_opts) {
+	return prepare(lut, party, batch_size, lut.size(), parallel, num_threads, (BatchPirType)type, (HashType)hash_type, io_gc, shard_opts);
+}
 
-	auto config = new FABLEConfig{
-		params->get_batch_size(), 
-		params->get_bucket_size(), 
-		(1ULL << LUT_INPUT_SIZE), 
-		LUT_INPUT_SIZE
-	};
+FABLEParams fable_prepare(map<uint64_t, rawdatablock>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, BatchPirType type, HashType hash_type, NetIO *io_gc) {
+	return prepare(lut, party, batch_size, db_size, parallel, num_threads, type, hash_type, io_gc, ShardOptions());
+}
 
-	BatchPIRServer* batch_server; 
-	BatchPIRClient* batch_client;
-	
-    osuCrypto::PRNG* prng = new osuCrypto::PRNG(osuCrypto::sysRandomSeed());
+// OPRF key, chosen by ALICE
+struct OPRFKey {
+    keyblock lowmc_key;
+    prefixblock lowmc_prefix;
+    oc::block aes_key;
+    std::bitset<128-DatabaseConstants::InputLength> aes_prefix;
+};
 
-	if (party == BOB) {
-		batch_client = new BatchPIRClient(*params);
-		auto [glk_buffer, rlk_buffer] = batch_client->get_public_keys();
+// OPRF outputs, one word per query. LowMC outputs take the low sci::blocksize bits.
+typedef vector<oc::block> OPRFOutputs;
+// A LowMC output is stored as the low word of its block, through bitset::to_ullong
+static_assert(sci::blocksize <= 64, "LowMC outputs must fit in one 64-bit word of an OPRF output");
 
-		// send key_buf and query_buf
-		uint32_t glk_size = glk_buffer.size(), rlk_size = rlk_buffer.size();
-		io_gc->send_data(&glk_size, sizeof(uint32_t));
-		io_gc->send_data(&rlk_size, sizeof(uint32_t));
-		io_gc->send_data(glk_buffer.data(), glk_size);
-		io_gc->send_data(rlk_buffer.data(), rlk_size);
-	} else {
-		batch_server = new BatchPIRServer(*params, *prng);
-		batch_server->populate_raw_db(lut);
-		uint32_t glk_size, rlk_size;
-		io_gc->recv_data(&glk_size, sizeof(uint32_t));
-		io_gc->recv_data(&rlk_size, sizeof(uint32_t));
-		vector<seal::seal_byte> glk_buffer(glk_size), rlk_buffer(rlk_size);
-		io_gc->recv_data(glk_buffer.data(), glk_size);
-		io_gc->recv_data(rlk_buffer.data(), rlk_size);
-		batch_server->set_client_keys(client_id, {glk_buffer, rlk_buffer});
-	}
-	
-	auto lut_params = FABLEParams{
-		party, 
-		hash_type, 
-		batch_size, 
-		config, 
-		prng, 
-		params,  
-		batch_server, 
-		batch_client, 
-		io_gc
-	};
-
-	return lut_params; 
+static int oprf_output_bits(HashType hash_type) {
+	return hash_type == HashType::LowMC ? sci::blocksize : 128;
 }
 
-IntegerArray fable_lookup(IntegerArray secret_queries, FABLEParams& lut_params, bool verbose) {
+// ALICE's AES key as a GC input, in the bit order of sci::AES
+static Integer share_aes_key(const oc::block& key) {
+	Integer aes_key(128, 0);
+	auto data = key.get<uint64_t>();
+	auto key_bitset = concatenate(std::bitset<64>(data[1]), std::bitset<64>(data[0]));
+	for (int i = 0; i < 128; i++) {
+		aes_key[i] = Bit(key_bitset[i], ALICE);
+	}
+	return aes_key;
+}
 
-	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc] = lut_params;
+// Evaluate the OPRF on the deduplicated queries. BOB learns the outputs, ALICE learns nothing.
+static OPRFOutputs evaluate_oprf(IntegerArray& secret_queries, FABLEParams& lut_params, OPRFKey& key) {
 
-	int num_bucket = params->get_num_buckets();
+	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc, num_shards, shards] = lut_params;
 	const int w = DatabaseConstants::NumHashFunctions;
 
-    // Deduplication
-	start_record(io_gc, "Deduplicate");
-	auto context = deduplicate(secret_queries, *config);
-	end_record(io_gc, "Deduplicate", verbose);
-
-	// prepare batch
-	start_record(io_gc, "OPRF Evaluation");
-	
-    keyblock lowmc_key; 
-    prefixblock lowmc_prefix; 
-    oc::block aes_key;
-    std::bitset<128-DatabaseConstants::InputLength> aes_prefix;
 	if (party == ALICE) {
 		if (hash_type == HashType::LowMC) {
-			lowmc_key = random_bitset<utils::keysize>(prng);
-			lowmc_prefix = 0; // random_bitset<utils::prefixsize>(&prng);
+			key.lowmc_key = random_bitset<utils::keysize>(prng);
+			key.lowmc_prefix = 0; // random_bitset<utils::prefixsize>(&prng);
 		} else {
-			aes_key = prng->get<oc::block>();
-			aes_prefix = 0;
+			key.aes_key = prng->get<oc::block>();
+			key.aes_prefix = 0;
 		}
 	}
 
-    vector<string> batch(batch_size);
-	sci::LowMC* lowmc_ciphers_2PC;
-	sci::AES* aes_ciphers_2PC;
+    OPRFOutputs batch(batch_size, oc::ZeroBlock);
 
 	if (hash_type == HashType::LowMC) {
-		lowmc_ciphers_2PC = new sci::LowMC(lowmc_key, ALICE, batch_size);
+		sci::LowMC lowmc_ciphers_2PC(key.lowmc_key, ALICE, batch_size);
 
 		secret_block m;
 		// Integer secret_prefix = share_bitset(lowmc_prefix, ALICE);
@@ -212,230 +208,291 @@ IntegerArray fable_lookup(IntegerArray secret_queries, FABLEParams& lut_params,
 		}
 
 		secret_block c;
-		c = lowmc_ciphers_2PC->encrypt(m); // blocksize, batchsize
+		c = lowmc_ciphers_2PC.encrypt(m); // blocksize, batchsize
+		vector<Bit> labels(batch_size * sci::blocksize);
 		for (int i = 0; i < batch_size; i++) {
-			block hash_out;
 			for (int j = 0; j < sci::blocksize; j++) {
-				hash_out[j] = c[j][i].reveal(BOB);
+				labels[i * sci::blocksize + j] = c[j][i];
 			}
-			batch[i] = hash_out.to_string();
+		}
+		auto hash_out = reveal_bitsets<sci::blocksize>(labels, BOB, party);
+		for (int i = 0; i < batch_size; i++) {
+			batch[i] = oc::block(0, hash_out[i].to_ullong());
 		}
 	} else {
 		vector<Integer> m(batch_size);
 		vector<Integer> c;
-		Integer key(128, 0);
-		auto data = aes_key.get<uint64_t>();
-		auto key_bitset = concatenate(std::bitset<64>(data[1]), std::bitset<64>(data[0]));
-		for (int i = 0; i < 128; i++) {
-			key[i] = Bit(key_bitset[i], ALICE);
-		}
-		aes_ciphers_2PC = new sci::AES(key);
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {	
-			Integer secret_prefix = share_bitset(aes_prefix, ALICE);
+		sci::AES aes_ciphers_2PC(share_aes_key(key.aes_key));
+		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
+			Integer secret_prefix = share_bitset(key.aes_prefix, ALICE);
 			for (int j = 0; j < batch_size; j++) {
 				m[j] = secret_queries[j];
 				m[j].bits.insert(m[j].bits.end(), secret_prefix.bits.begin(), secret_prefix.bits.end());
 			}
-			c = aes_ciphers_2PC->EncryptECB(m);
+			c = aes_ciphers_2PC.EncryptECB(m);
+			vector<Bit> labels;
+			labels.reserve(batch_size * 128);
 			for (int i = 0; i < batch_size; i++) {
-				std::bitset<128> hash_out;
-				for (int j = 0; j < 128; j++) {
-					hash_out[j] = c[i][j].reveal(BOB);
-				}
-				batch[i] = hash_out.to_string();
+				labels.insert(labels.end(), c[i].bits.begin(), c[i].bits.end());
+			}
+			auto hash_out = reveal_bitsets<128>(labels, BOB, party);
+			for (int i = 0; i < batch_size; i++) {
+				batch[i] = oc::block((hash_out[i] >> 64).to_ullong(), (hash_out[i] & std::bitset<128>(~0ULL)).to_ullong());
 			}
 		}
 	}
-	end_record(io_gc, "OPRF Evaluation", verbose);
-
-	// PIR
-	start_record(io_gc, "Share Retrieval");
+	return batch;
+}
 
-	vector<IntegerArray> A_index(w, IntegerArray(num_bucket));
-	vector<IntegerArray> A_entry(w, IntegerArray(num_bucket));
-	vector<IntegerArray> B_index(w, IntegerArray(num_bucket));
-	vector<IntegerArray> B_entry(w, IntegerArray(num_bucket));
-	vector<IntegerArray> index(w, IntegerArray(num_bucket));
-	vector<IntegerArray> entry(w, IntegerArray(num_bucket));
+// Route the deduplicated queries to the shards: BOB learns the ShardRouter PRF of every query, evaluated in GC under
+// ALICE's key, and ALICE learns nothing. The PRF outputs are pseudorandom, and the deduplicated queries distinct, so
+// the shards tell BOB nothing about the queries. Without sharding, every query goes to shard 0. 
+static vector<int> route_queries(IntegerArray& secret_queries, FABLEParams& lut_params) {
+	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc, num_shards, shards] = lut_params;
+	vector<int> routes(batch_size, 0);
+	if (num_shards == 1)
+		return routes;
+
+	sci::AES router_2PC(share_aes_key(party == ALICE ? shards->router().key : oc::ZeroBlock));
+	vector<Integer> m(batch_size);
+	for (int i = 0; i < batch_size; i++) {
+		m[i] = secret_queries[i];
+		m[i].bits.resize(128, Bit(0));
+	}
+	auto c = router_2PC.EncryptECB(m);
+	vector<Bit> labels;
+	labels.reserve(batch_size * 64);
+	for (int i = 0; i < batch_size; i++) {
+		labels.insert(labels.end(), c[i].bits.begin(), c[i].bits.begin() + 64);
+	}
+	auto prf_out = reveal_bitsets<64>(labels, BOB, party);
+	for (int i = 0; i < batch_size; i++) {
+		routes[i] = prf_out[i].to_ullong() % num_shards;
+	}
+	return routes;
+}
 
-	if (party == BOB) {
-		start_record(io_gc, "Query Computation");
-		auto queries = batch_client->create_queries(batch);
-		auto query_buffer = batch_client->serialize_query(queries);
-		end_record(io_gc, "Query Computation", verbose);
-
-		start_record(io_gc, "Query Communication");
-        for (int i = 0; i < params->query_size[0]; i++) {
-            for (int j = 0; j < params->query_size[1]; j++) {
-                for (int k = 0; k < params->query_size[2]; k++) {
-					uint32_t buf_size = query_buffer[i][j][k].size();
-					io_gc->send_data(&buf_size, sizeof(uint32_t));
-                    io_gc->send_data(query_buffer[i][j][k].data(), buf_size);
-                }
-            }
-        }
-		end_record(io_gc, "Query Communication", verbose);
-
-
-		start_record(io_gc, "Answer Communication");
-		vector<vector<vector<seal_byte>>> response_buffer(params->response_size[0]);
-		for (int i = 0; i < params->response_size[0]; i++) {
-            response_buffer[i].resize(params->response_size[1]);
-			for (int j = 0; j < params->response_size[1]; j++) {
-				uint32_t buf_size;
-				io_gc->recv_data(&buf_size, sizeof(uint32_t));
-				response_buffer[i][j].resize(buf_size);
-				io_gc->recv_data(response_buffer[i][j].data(), buf_size);
-			}
+// ALICE: hash the LUT under the OPRF key and encode the bucket databases
+static void server_setup(FABLEParams& lut_params, OPRFKey& key, bool verbose) {
+	start_record(lut_params.io_gc, "Server Setup");
+	if (lut_params.shards) {
+		if (lut_params.params->get_hash_type() == HashType::LowMC) {
+			lut_params.shards->prepare(key.lowmc_key, key.lowmc_prefix);
+		} else {
+			lut_params.shards->prepare(key.aes_key, key.aes_prefix);
+		}
+	} else {
+		if (lut_params.params->get_hash_type() == HashType::LowMC) {
+			lut_params.batch_server->lowmc_prepare(key.lowmc_key, key.lowmc_prefix);
+		} else {
+			lut_params.batch_server->aes_prepare(key.aes_key, key.aes_prefix);
 		}
-		end_record(io_gc, "Answer Communication", verbose);
+		lut_params.batch_server->initialize();
+	}
+	end_record(lut_params.io_gc, "Server Setup", verbose);
+}
 
-		start_record(io_gc, "Extraction");
-		auto responses = batch_client->deserialize_response(response_buffer);
-		auto decode_responses = batch_client->decode_responses(responses);
-		end_record(io_gc, "Extraction", verbose);
+// BatchPIRClient takes its cuckoo keys as '0'/'1' strings, most significant bit first. The outputs stay binary up to
+// here, and every key is written in place in one pass.
+static vector<string> client_keys(const OPRFOutputs& batch, int width) {
+	vector<string> keys(batch.size(), string(width, '0'));
+	for (size_t i = 0; i < batch.size(); i++) {
+		auto words = batch[i].get<uint64_t>();
+		for (int j = 0; j < width; j++)
+			if ((words[j / 64] >> (j % 64)) & 1)
+				keys[i][width - 1 - j] = '1';
+	}
+	return keys;
+}
 
-		start_record(io_gc, "Share Conversion");
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				A_index[hash_idx][bucket_idx] = Integer(LUT_INPUT_SIZE+1, 0, ALICE);
-				A_entry[hash_idx][bucket_idx] = Integer(LUT_OUTPUT_SIZE, 0, ALICE);
+// BOB: build the PIR queries of every shard from the OPRF outputs routed to it, padded with random outputs to the shard
+// batch size, and send them. Returns the plain sort key that routes every query to its cuckoo bucket, where the
+// buckets of shard s follow those of shards 0..s-1 and the buckets without a query follow the queries.
+static vector<int> send_queries(FABLEParams& lut_params, OPRFOutputs& batch, const vector<int>& routes, bool verbose) {
+	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc, num_shards, shards] = lut_params;
+	int num_bucket = params->get_num_buckets();
+	uint64_t shard_batch = shard_batch_size(batch_size, num_shards);
+	int width = oprf_output_bits((HashType)hash_type);
+
+	start_record(io_gc, "Query Computation");
+	vector<int> sort_reference(num_shards * num_bucket, 0);
+	vector<bool> occupied(num_shards * num_bucket, false);
+	vector<QueryBuffer> query_buffers;
+	for (int shard_idx = 0; shard_idx < num_shards; shard_idx++) {
+		OPRFOutputs shard_outputs;
+		vector<int> positions;
+		for (int i = 0; i < batch_size; i++) {
+			if (routes[i] == shard_idx) {
+				shard_outputs.push_back(batch[i]);
+				positions.push_back(i);
 			}
 		}
+		utils::check(shard_outputs.size() <= shard_batch, fmt::format("[FABLE] {} queries were routed to shard {}, which takes {}. ", shard_outputs.size(), shard_idx, shard_batch));
+		while (shard_outputs.size() < shard_batch)
+			shard_outputs.push_back(prng->get<oc::block>());
 
-		int total_length = w * num_bucket * datablock_size;
-		bool* b = new bool[total_length];
-		vector<Bit> bits(total_length);
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				auto [index, entry] = utils::split<DatabaseConstants::InputLength>(decode_responses[bucket_idx][hash_idx]);
-				for (int bit_idx = 0; bit_idx < datablock_size; bit_idx++) {
-					if (bit_idx < DatabaseConstants::InputLength) {
-						b[hash_idx * num_bucket * datablock_size + bucket_idx * datablock_size + bit_idx] = index[bit_idx];
-					} else {
-						b[hash_idx * num_bucket * datablock_size + bucket_idx * datablock_size + bit_idx] = entry[bit_idx - DatabaseConstants::InputLength];
-					}
-				}
-			}
+		auto queries = batch_client->create_queries(client_keys(shard_outputs, width));
+		query_buffers.push_back(batch_client->serialize_query(queries));
+		for (size_t i = 0; i < positions.size(); i++) {
+			int bucket_idx = shard_idx * num_bucket + batch_client->inv_cuckoo_map[i];
+			sort_reference[positions[i]] = bucket_idx;
+			occupied[bucket_idx] = true;
 		}
-		prot_exec->feed((block128 *)bits.data(), BOB, b, total_length); 
-		delete[] b;
+	}
+	int dummy_idx = batch_size;
+	for (int bucket_idx = 0; bucket_idx < num_shards * num_bucket; bucket_idx++) {
+		if (!occupied[bucket_idx])
+			sort_reference[dummy_idx++] = bucket_idx;
+	}
+	end_record(io_gc, "Query Computation", verbose);
 
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				auto start_it = bits.begin() + (hash_idx * num_bucket * datablock_size + bucket_idx * datablock_size);
-				B_index[hash_idx][bucket_idx].bits = vector<Bit>(start_it, start_it + DatabaseConstants::InputLength);
-				B_entry[hash_idx][bucket_idx].bits = vector<Bit>(start_it + DatabaseConstants::InputLength, start_it + datablock_size);
+	start_record(io_gc, "Query Communication");
+	for (auto& query_buffer : query_buffers)
+		send_query(io_gc, params, query_buffer);
+	end_record(io_gc, "Query Communication", verbose);
+	return sort_reference;
+}
+
+// ALICE: receive BOB's PIR queries, one per shard
+static vector<QueryBuffer> recv_queries(FABLEParams& lut_params, bool verbose) {
+	start_record(lut_params.io_gc, "Query Communication");
+	vector<QueryBuffer> query_buffers;
+	for (int shard_idx = 0; shard_idx < lut_params.num_shards; shard_idx++)
+		query_buffers.push_back(recv_query(lut_params.io_gc, lut_params.params));
+	end_record(lut_params.io_gc, "Query Communication", verbose);
+	return query_buffers;
+}
+
+// ALICE: answer the queries in-process or through the shard workers, and send the responses to BOB.
+// Returns ALICE's share of the retrieved (index, entry) pairs, i.e., the PIR masks, per (shard, hash function, bucket).
+static MaskBits answer_queries(FABLEParams& lut_params, vector<QueryBuffer>& query_buffers, bool verbose) {
+	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc, num_shards, shards] = lut_params;
+	const int w = DatabaseConstants::NumHashFunctions;
+	int num_bucket = params->get_num_buckets();
+
+	start_record(io_gc, "Answer Computation");
+	vector<ResponseBuffer> response_buffers;
+	MaskBits masks;
+	if (shards) {
+		auto answers = shards->answer(query_buffers);
+		std::map<int, std::tuple<int, uint64_t, double>> node_stats; // node -> (#shards, rows, slowest answer)
+		for (int shard_idx = 0; shard_idx < num_shards; shard_idx++) {
+			auto& answer = answers[shard_idx];
+			response_buffers.push_back(std::move(answer.response));
+			masks.insert(masks.end(), answer.masks.begin(), answer.masks.end());
+			auto& [node_shards, node_rows, node_ms] = node_stats[answer.node];
+			node_shards++;
+			node_rows += answer.num_rows;
+			node_ms = std::max(node_ms, answer.answer_ms);
+			if (verbose)
+				cout << fmt::format("    shard {}: {} rows answered in {} ms. ", shard_idx, answer.num_rows, answer.answer_ms) << endl;
+		}
+		if (verbose) {
+			for (auto& [node, stats] : node_stats) {
+				auto& [node_shards, node_rows, node_ms] = stats;
+				cout << fmt::format("    node {}: {} shard(s), {} rows in {} ms, {:.2f} Mrows/s. ", node < 0 ? "unbound" : std::to_string(node), node_shards, node_rows, node_ms, node_rows / std::max(node_ms, 1e-3) / 1e3) << endl;
 			}
 		}
 	} else {
-		start_record(io_gc, "Server Setup");
-		if (params->get_hash_type() == HashType::LowMC) {
-			batch_server->lowmc_prepare(lowmc_key, lowmc_prefix);
-		} else {
-			batch_server->aes_prepare(aes_key, aes_prefix);
-		}
-		batch_server->initialize();
-		end_record(io_gc, "Server Setup", verbose);
-
-		start_record(io_gc, "Query Communication");
-		vector<vector<vector<vector<seal_byte>>>> query_buffer(params->query_size[0]);
-        for (int i = 0; i < params->query_size[0]; i++) {
-            query_buffer[i].resize(params->query_size[1]);
-            for (int j = 0; j < params->query_size[1]; j++) {
-                query_buffer[i][j].resize(params->query_size[2]);
-                for (int k = 0; k < params->query_size[2]; k++) {
-					uint32_t buf_size;
-					io_gc->recv_data(&buf_size, sizeof(uint32_t));
-					query_buffer[i][j][k].resize(buf_size);
-                    io_gc->recv_data(query_buffer[i][j][k].data(), buf_size);
-                }
-            }
-        }
-		end_record(io_gc, "Query Communication", verbose);
-
-		start_record(io_gc, "Answer Computation");
-		auto queries = batch_server->deserialize_query(query_buffer);
+		auto queries = batch_server->deserialize_query(query_buffers[0]);
 		vector<PIRResponseList> responses = batch_server->generate_response(client_id, queries);
-		auto response_buffer = batch_server->serialize_response(responses);
-		end_record(io_gc, "Answer Computation", verbose);
-
-		start_record(io_gc, "Answer Communication");
-		for (int i = 0; i < params->response_size[0]; i++) {
-            for (int j = 0; j < params->response_size[1]; j++) {
-				uint32_t buf_size = response_buffer[i][j].size();
-				io_gc->send_data(&buf_size, sizeof(uint32_t));
-				io_gc->send_data(response_buffer[i][j].data(), buf_size);
-            }
-        }
-		end_record(io_gc, "Answer Communication", verbose);
-		
-		start_record(io_gc, "Share Conversion");
+		response_buffers.push_back(batch_server->serialize_response(responses));
+
+		masks.resize(w * num_bucket * datablock_size);
 		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
 			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				bool* index_mask_buffer = new bool[LUT_INPUT_SIZE+1];
-				for (int i = 0; i < LUT_INPUT_SIZE+1; i++) 
-					index_mask_buffer[i] = batch_server->index_masks[hash_idx][bucket_idx][i];
-				A_index[hash_idx][bucket_idx].bits.resize(LUT_INPUT_SIZE+1);
-				prot_exec->feed((block128 *)A_index[hash_idx][bucket_idx].bits.data(), ALICE, index_mask_buffer, LUT_INPUT_SIZE+1); 
-				delete[] index_mask_buffer;
-
-				bool* entry_mask_buffer = new bool[LUT_OUTPUT_SIZE];
-				for (int i = 0; i < LUT_OUTPUT_SIZE; i++) 
-					entry_mask_buffer[i] = batch_server->entry_masks[hash_idx][bucket_idx][i];
-				A_entry[hash_idx][bucket_idx].bits.resize(LUT_OUTPUT_SIZE);
-				prot_exec->feed((block128 *)A_entry[hash_idx][bucket_idx].bits.data(), ALICE, entry_mask_buffer, LUT_OUTPUT_SIZE); 
-				delete[] entry_mask_buffer;
+				auto mask = masks.data() + (hash_idx * num_bucket + bucket_idx) * datablock_size;
+				for (int i = 0; i < DatabaseConstants::InputLength; i++)
+					mask[i] = batch_server->index_masks[hash_idx][bucket_idx][i];
+				for (int i = 0; i < LUT_OUTPUT_SIZE; i++)
+					mask[DatabaseConstants::InputLength + i] = batch_server->entry_masks[hash_idx][bucket_idx][i];
 			}
 		}
+	}
+	end_record(io_gc, "Answer Computation", verbose);
+
+	start_record(io_gc, "Answer Communication");
+	for (auto& response_buffer : response_buffers)
+		send_response(io_gc, params, response_buffer);
+	end_record(io_gc, "Answer Communication", verbose);
+
+	return masks;
+}
+
+// BOB: receive and decrypt the responses of every shard.
+// Returns BOB's share of the retrieved (index, entry) pairs, laid out as in answer_queries.
+static MaskBits recv_answers(FABLEParams& lut_params, bool verbose) {
+	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc, num_shards, shards] = lut_params;
+	const int w = DatabaseConstants::NumHashFunctions;
+	int num_bucket = params->get_num_buckets();
 
-		int total_length = w * num_bucket * datablock_size;
-		bool* b = new bool[total_length];
-		std::fill(b, b + total_length, false);
-		vector<Bit> bits(total_length);
-		prot_exec->feed((block128 *)bits.data(), BOB, b, total_length); 
-		delete[] b;
+	start_record(io_gc, "Answer Communication");
+	vector<ResponseBuffer> response_buffers;
+	for (int shard_idx = 0; shard_idx < num_shards; shard_idx++)
+		response_buffers.push_back(recv_response(io_gc, params));
+	end_record(io_gc, "Answer Communication", verbose);
 
+	start_record(io_gc, "Extraction");
+	MaskBits b(num_shards * w * num_bucket * datablock_size);
+	for (int shard_idx = 0; shard_idx < num_shards; shard_idx++) {
+		auto responses = batch_client->deserialize_response(response_buffers[shard_idx]);
+		auto decode_responses = batch_client->decode_responses(responses);
 		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
 			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				auto start_it = bits.begin() + (hash_idx * num_bucket * datablock_size + bucket_idx * datablock_size);
-				B_index[hash_idx][bucket_idx].bits = vector<Bit>(start_it, start_it + DatabaseConstants::InputLength);
-				B_entry[hash_idx][bucket_idx].bits = vector<Bit>(start_it + DatabaseConstants::InputLength, start_it + datablock_size);
+				auto [index, entry] = utils::split<DatabaseConstants::InputLength>(decode_responses[bucket_idx][hash_idx]);
+				auto slot = b.data() + ((shard_idx * w + hash_idx) * num_bucket + bucket_idx) * datablock_size;
+				for (int bit_idx = 0; bit_idx < datablock_size; bit_idx++) {
+					if (bit_idx < DatabaseConstants::InputLength) {
+						slot[bit_idx] = index[bit_idx];
+					} else {
+						slot[bit_idx] = entry[bit_idx - DatabaseConstants::InputLength];
+					}
+				}
 			}
 		}
 	}
+	end_record(io_gc, "Extraction", verbose);
+	return b;
+}
 
-	for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			index[hash_idx][bucket_idx] = A_index[hash_idx][bucket_idx] ^ B_index[hash_idx][bucket_idx];
-			entry[hash_idx][bucket_idx] = A_entry[hash_idx][bucket_idx] ^ B_entry[hash_idx][bucket_idx];
-		}
-	}
-	end_record(io_gc, "Share Conversion", verbose);
-
-	end_record(io_gc, "Share Retrieval", verbose);
+// Combine ALICE's masks and BOB's decrypted values into secret (index, entry) pairs, one per (hash function, bucket),
+// where the buckets of all shards are concatenated
+static void share_conversion(FABLEParams& lut_params, MaskBits& share, vector<IntegerArray>& index, vector<IntegerArray>& entry, bool verbose) {
+	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc, num_shards, shards] = lut_params;
+	const int w = DatabaseConstants::NumHashFunctions;
+	int num_bucket = params->get_num_buckets();
 
-	start_record(io_gc, "Decode");
-	
-	// Gen Context
-	vector<int> sort_reference(num_bucket, 0);
-	if (party == BOB) {
-		set<int> dummy_buckets;
-		for(int bucket_idx = 0; bucket_idx < num_bucket; ++bucket_idx) {
-			if (batch_client->cuckoo_map.count(bucket_idx) == 0)
-				dummy_buckets.insert(bucket_idx);
-		}
-		vector<int> dummies(dummy_buckets.begin(), dummy_buckets.end());
-		for (int i = 0; i < batch_size; i++) {
-			sort_reference[i] = batch_client->inv_cuckoo_map[i];
-		}
-		for (int i = batch_size; i < num_bucket; i++) {
-			sort_reference[i] = dummies[i - batch_size];
+	start_record(io_gc, "Share Conversion");
+	int total_length = num_shards * w * num_bucket * datablock_size;
+	MaskBits zeros(total_length, 0);
+	vector<Bit> A_bits(total_length), B_bits(total_length);
+	prot_exec->feed((block128 *)A_bits.data(), ALICE, (bool*)(party == ALICE ? share.data() : zeros.data()), total_length);
+	prot_exec->feed((block128 *)B_bits.data(), BOB, (bool*)(party == BOB ? share.data() : zeros.data()), total_length);
+
+	index.assign(w, IntegerArray(num_shards * num_bucket));
+	entry.assign(w, IntegerArray(num_shards * num_bucket));
+	for (int slot_idx = 0; slot_idx < num_shards * w; slot_idx++) {
+		int shard_idx = slot_idx / w, hash_idx = slot_idx % w;
+		for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
+			int offset = (slot_idx * num_bucket + bucket_idx) * datablock_size;
+			auto& slot_index = index[hash_idx][shard_idx * num_bucket + bucket_idx];
+			auto& slot_entry = entry[hash_idx][shard_idx * num_bucket + bucket_idx];
+			slot_index.bits.resize(DatabaseConstants::InputLength);
+			slot_entry.bits.resize(datablock_size - DatabaseConstants::InputLength);
+			for (int bit_idx = 0; bit_idx < datablock_size; bit_idx++) {
+				if (bit_idx < DatabaseConstants::InputLength) {
+					slot_index[bit_idx] = A_bits[offset + bit_idx] ^ B_bits[offset + bit_idx];
+				} else {
+					slot_entry[bit_idx - DatabaseConstants::InputLength] = A_bits[offset + bit_idx] ^ B_bits[offset + bit_idx];
+				}
+			}
 		}
 	}
-	CompResultType sort_res = sort(sort_reference, num_bucket, BOB);
+	end_record(io_gc, "Share Conversion", verbose);
+}
 
-	// Collect result
+// For every bucket, select the entry whose index matches the query routed to that bucket, among its w slots
+static IntegerArray collect_result(IntegerArray& secret_queries, CompResultType& sort_res, vector<IntegerArray>& index, vector<IntegerArray>& entry, int num_bucket) {
 	auto zero_index = Integer(LUT_INPUT_SIZE+1, 0);
 	secret_queries.resize(num_bucket, zero_index);
 	permute(sort_res, secret_queries);
@@ -444,43 +501,34 @@ IntegerArray fable_lookup(IntegerArray secret_queries, FABLEParams& lut_params,
 	IntegerArray result(num_bucket, zero_entry);
 	for(int bucket_idx = 0; bucket_idx < num_bucket; ++bucket_idx) {
 		auto selected_query = secret_queries[bucket_idx];
-		
-		for (int hash_idx = 0; hash_idx < w; ++hash_idx) {
-			result[bucket_idx] = result[bucket_idx] ^ If(selected_query == index[hash_idx][bucket_idx], entry[hash_idx][bucket_idx], zero_entry);
+
+		for (int slot_idx = 0; slot_idx < index.size(); ++slot_idx) {
+			result[bucket_idx] = result[bucket_idx] ^ If(selected_query == index[slot_idx][bucket_idx], entry[slot_idx][bucket_idx], zero_entry);
 		}
 	}
 
 	permute(sort_res, result, true);
-	end_record(io_gc, "Decode", verbose);
-	
-	// Remapping
-	start_record(io_gc, "Mapping");
-	remap(result, context);
-	end_record(io_gc, "Mapping", verbose);
-	
-	if (party == ALICE) {
-		delete batch_server;
-	} else {
-		delete batch_client;
-	}
-	delete prng;
-	delete params;
-	delete config;
-	if (hash_type == HashType::LowMC) {
-		delete lowmc_ciphers_2PC;
+	return result;
+}
+
+static void release(FABLEParams& lut_params) {
+	if (lut_params.party == ALICE) {
+		delete lut_params.batch_server;
+		delete lut_params.shards;
 	} else {
-		delete aes_ciphers_2PC;
+		delete lut_params.batch_client;
 	}
-    
-    return result;
+	delete lut_params.prng;
+	delete lut_params.params;
+	delete lut_params.config;
 }
 
-IntegerArray fable_lookup_fuse(IntegerArray secret_queries, FABLEParams& lut_params, bool verbose) {
+IntegerArray fable_lookup(IntegerArray secret_queries, FABLEParams& lut_params, bool verbose) {
 
-	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc] = lut_params;
+	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc, num_shards, shards] = lut_params;
 
-	int num_bucket = params->get_num_buckets();
-	const int w = DatabaseConstants::NumHashFunctions;
+	// The buckets of all shards, concatenated
+	int num_bucket = num_shards * params->get_num_buckets();
 
     // Deduplication
 	start_record(io_gc, "Deduplicate");
@@ -489,307 +537,124 @@ IntegerArray fable_lookup_fuse(IntegerArray secret_queries, FABLEParams& lut_par
 
 	// prepare batch
 	start_record(io_gc, "OPRF Evaluation");
-	
-    keyblock lowmc_key; 
-    prefixblock lowmc_prefix; 
-    oc::block aes_key;
-    std::bitset<128-DatabaseConstants::InputLength> aes_prefix;
-	if (party == ALICE) {
-		if (hash_type == HashType::LowMC) {
-			lowmc_key = random_bitset<utils::keysize>(prng);
-			lowmc_prefix = 0; // random_bitset<utils::prefixsize>(&prng);
-		} else {
-			aes_key = prng->get<oc::block>();
-			aes_prefix = 0;
-		}
-	}
-
-    vector<string> batch(batch_size);
-	sci::LowMC* lowmc_ciphers_2PC;
-	sci::AES* aes_ciphers_2PC;
+	OPRFKey key;
+	auto batch = evaluate_oprf(secret_queries, lut_params, key);
+	auto routes = route_queries(secret_queries, lut_params);
+	end_record(io_gc, "OPRF Evaluation", verbose);
 
-	if (hash_type == HashType::LowMC) {
-		lowmc_ciphers_2PC = new sci::LowMC(lowmc_key, ALICE, batch_size);
+	// PIR
+	start_record(io_gc, "Share Retrieval");
 
-		secret_block m;
-		// Integer secret_prefix = share_bitset(lowmc_prefix, ALICE);
-		for (int j = 0; j < sci::blocksize; j++) {
-			m[j].bits.resize(batch_size);
-			if (j >= LUT_INPUT_SIZE+1) {
-				m[j].bits.assign(batch_size, Bit(0));
-				// m[j].bits.assign(batch_size, secret_prefix[j-bitlength-1]);
-			} else {
-				for (int i = 0; i < batch_size; i++) {
-					m[j][i] = secret_queries[i][j];
-				}
-			}
-		}
+	vector<IntegerArray> index, entry;
+	MaskBits share;
+	vector<int> sort_reference(num_bucket, 0);
 
-		secret_block c;
-		c = lowmc_ciphers_2PC->encrypt(m); // blocksize, batchsize
-		for (int i = 0; i < batch_size; i++) {
-			block hash_out;
-			for (int j = 0; j < sci::blocksize; j++) {
-				hash_out[j] = c[j][i].reveal(BOB);
-			}
-			batch[i] = hash_out.to_string();
-		}
+	if (party == BOB) {
+		sort_reference = send_queries(lut_params, batch, routes, verbose);
+		share = recv_answers(lut_params, verbose);
 	} else {
-		vector<Integer> m(batch_size);
-		vector<Integer> c;
-		Integer key(128, 0);
-		auto data = aes_key.get<uint64_t>();
-		auto key_bitset = concatenate(std::bitset<64>(data[1]), std::bitset<64>(data[0]));
-		for (int i = 0; i < 128; i++) {
-			key[i] = Bit(key_bitset[i], ALICE);
-		}
-		aes_ciphers_2PC = new sci::AES(key);
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {	
-			Integer secret_prefix = share_bitset(aes_prefix, ALICE);
-			for (int j = 0; j < batch_size; j++) {
-				m[j] = secret_queries[j];
-				m[j].bits.insert(m[j].bits.end(), secret_prefix.bits.begin(), secret_prefix.bits.end());
-			}
-			c = aes_ciphers_2PC->EncryptECB(m);
-			for (int i = 0; i < batch_size; i++) {
-				std::bitset<128> hash_out;
-				for (int j = 0; j < 128; j++) {
-					hash_out[j] = c[i][j].reveal(BOB);
-				}
-				batch[i] = hash_out.to_string();
-			}
-		}
+		server_setup(lut_params, key, verbose);
+		auto query_buffers = recv_queries(lut_params, verbose);
+		share = answer_queries(lut_params, query_buffers, verbose);
 	}
+	share_conversion(lut_params, share, index, entry, verbose);
+
+	end_record(io_gc, "Share Retrieval", verbose);
+
+	start_record(io_gc, "Decode");
+
+	// Gen Context
+	CompResultType sort_res = sort(sort_reference, num_bucket, BOB);
+
+	// Collect result
+	auto result = collect_result(secret_queries, sort_res, index, entry, num_bucket);
+	end_record(io_gc, "Decode", verbose);
+
+	// Remapping
+	start_record(io_gc, "Mapping");
+	remap(result, context);
+	end_record(io_gc, "Mapping", verbose);
+
+	release(lut_params);
+
+    return result;
+}
+
+IntegerArray fable_lookup_fuse(IntegerArray secret_queries, FABLEParams& lut_params, bool verbose) {
+
+	auto& [party, hash_type, batch_size, config, prng, params, batch_server, batch_client, io_gc, num_shards, shards] = lut_params;
+
+	// The buckets of all shards, concatenated
+	int num_bucket = num_shards * params->get_num_buckets();
+
+    // Deduplication
+	start_record(io_gc, "Deduplicate");
+	auto context = deduplicate(secret_queries, *config);
+	end_record(io_gc, "Deduplicate", verbose);
+
+	// prepare batch
+	start_record(io_gc, "OPRF Evaluation");
+	OPRFKey key;
+	auto batch = evaluate_oprf(secret_queries, lut_params, key);
+	auto routes = route_queries(secret_queries, lut_params);
 	end_record(io_gc, "OPRF Evaluation", verbose);
 
 	// PIR
 	start_record(io_gc, "Share Retrieval + Decode");
 
-	vector<IntegerArray> A_index(w, IntegerArray(num_bucket));
-	vector<IntegerArray> A_entry(w, IntegerArray(num_bucket));
-	vector<IntegerArray> B_index(w, IntegerArray(num_bucket));
-	vector<IntegerArray> B_entry(w, IntegerArray(num_bucket));
-	vector<IntegerArray> index(w, IntegerArray(num_bucket));
-	vector<IntegerArray> entry(w, IntegerArray(num_bucket));
+	vector<IntegerArray> index, entry;
+	MaskBits share;
 	vector<int> sort_reference(num_bucket, 0);
 	CompResultType sort_res;
 
 	if (party == BOB) {
-		start_record(io_gc, "Query Computation");
-		auto queries = batch_client->create_queries(batch);
-		auto query_buffer = batch_client->serialize_query(queries);
-		end_record(io_gc, "Query Computation", verbose);
-
-		start_record(io_gc, "Query Communication");
-        for (int i = 0; i < params->query_size[0]; i++) {
-            for (int j = 0; j < params->query_size[1]; j++) {
-                for (int k = 0; k < params->query_size[2]; k++) {
-					uint32_t buf_size = query_buffer[i][j][k].size();
-					io_gc->send_data(&buf_size, sizeof(uint32_t));
-                    io_gc->send_data(query_buffer[i][j][k].data(), buf_size);
-                }
-            }
-        }
-		end_record(io_gc, "Query Communication", verbose);
+		sort_reference = send_queries(lut_params, batch, routes, verbose);
 
 		start_record(io_gc, "Context Generation");
-		set<int> dummy_buckets;
-		for(int bucket_idx = 0; bucket_idx < num_bucket; ++bucket_idx) {
-			if (batch_client->cuckoo_map.count(bucket_idx) == 0)
-				dummy_buckets.insert(bucket_idx);
-		}
-		vector<int> dummies(dummy_buckets.begin(), dummy_buckets.end());
-		for (int i = 0; i < batch_size; i++) {
-			sort_reference[i] = batch_client->inv_cuckoo_map[i];
-		}
-		for (int i = batch_size; i < num_bucket; i++) {
-			sort_reference[i] = dummies[i - batch_size];
-		}
 		sort_res = sort(sort_reference, num_bucket, BOB);
 		end_record(io_gc, "Context Generation");
 
-		start_record(io_gc, "Answer Communication");
-		vector<vector<vector<seal_byte>>> response_buffer(params->response_size[0]);
-		for (int i = 0; i < params->response_size[0]; i++) {
-            response_buffer[i].resize(params->response_size[1]);
-			for (int j = 0; j < params->response_size[1]; j++) {
-				uint32_t buf_size;
-				io_gc->recv_data(&buf_size, sizeof(uint32_t));
-				response_buffer[i][j].resize(buf_size);
-				io_gc->recv_data(response_buffer[i][j].data(), buf_size);
-			}
-		}
-		end_record(io_gc, "Answer Communication", verbose);
-
-		start_record(io_gc, "Extraction");
-		auto responses = batch_client->deserialize_response(response_buffer);
-		auto decode_responses = batch_client->decode_responses(responses);
-		end_record(io_gc, "Extraction", verbose);
-
-		start_record(io_gc, "Share Conversion");
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				A_index[hash_idx][bucket_idx] = Integer(LUT_INPUT_SIZE+1, 0, ALICE);
-				A_entry[hash_idx][bucket_idx] = Integer(LUT_OUTPUT_SIZE, 0, ALICE);
-			}
-		}
-
-		int total_length = w * num_bucket * datablock_size;
-		bool* b = new bool[total_length];
-		vector<Bit> bits(total_length);
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				auto [index, entry] = utils::split<DatabaseConstants::InputLength>(decode_responses[bucket_idx][hash_idx]);
-				for (int bit_idx = 0; bit_idx < datablock_size; bit_idx++) {
-					if (bit_idx < DatabaseConstants::InputLength) {
-						b[hash_idx * num_bucket * datablock_size + bucket_idx * datablock_size + bit_idx] = index[bit_idx];
-					} else {
-						b[hash_idx * num_bucket * datablock_size + bucket_idx * datablock_size + bit_idx] = entry[bit_idx - DatabaseConstants::InputLength];
-					}
-				}
-			}
-		}
-		prot_exec->feed((block128 *)bits.data(), BOB, b, total_length); 
-		delete[] b;
-
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				auto start_it = bits.begin() + (hash_idx * num_bucket * datablock_size + bucket_idx * datablock_size);
-				B_index[hash_idx][bucket_idx].bits = vector<Bit>(start_it, start_it + DatabaseConstants::InputLength);
-				B_entry[hash_idx][bucket_idx].bits = vector<Bit>(start_it + DatabaseConstants::InputLength, start_it + datablock_size);
-			}
-		}
+		share = recv_answers(lut_params, verbose);
 	} else {
-		start_record(io_gc, "Server Setup");
-		if (params->get_hash_type() == HashType::LowMC) {
-			batch_server->lowmc_prepare(lowmc_key, lowmc_prefix);
-		} else {
-			batch_server->aes_prepare(aes_key, aes_prefix);
-		}
-		batch_server->initialize();
-		end_record(io_gc, "Server Setup", verbose);
-
-		start_record(io_gc, "Query Communication");
-		vector<vector<vector<vector<seal_byte>>>> query_buffer(params->query_size[0]);
-        for (int i = 0; i < params->query_size[0]; i++) {
-            query_buffer[i].resize(params->query_size[1]);
-            for (int j = 0; j < params->query_size[1]; j++) {
-                query_buffer[i][j].resize(params->query_size[2]);
-                for (int k = 0; k < params->query_size[2]; k++) {
-					uint32_t buf_size;
-					io_gc->recv_data(&buf_size, sizeof(uint32_t));
-					query_buffer[i][j][k].resize(buf_size);
-                    io_gc->recv_data(query_buffer[i][j][k].data(), buf_size);
-                }
-            }
-        }
-		end_record(io_gc, "Query Communication", verbose);
-		
+		server_setup(lut_params, key, verbose);
+		auto query_buffers = recv_queries(lut_params, verbose);
+
 		start_record(io_gc, "Context Generation");
 		sort_res = sort(sort_reference, num_bucket, BOB);
 		end_record(io_gc, "Context Generation");
 
-		start_record(io_gc, "Answer Computation");
-		auto queries = batch_server->deserialize_query(query_buffer);
-		vector<PIRResponseList> responses = batch_server->generate_response(client_id, queries);
-		auto response_buffer = batch_server->serialize_response(responses);
-		end_record(io_gc, "Answer Computation", verbose);
-
-		start_record(io_gc, "Answer Communication");
-		for (int i = 0; i < params->response_size[0]; i++) {
-            for (int j = 0; j < params->response_size[1]; j++) {
-				uint32_t buf_size = response_buffer[i][j].size();
-				io_gc->send_data(&buf_size, sizeof(uint32_t));
-				io_gc->send_data(response_buffer[i][j].data(), buf_size);
-            }
-        }
-		end_record(io_gc, "Answer Communication", verbose);
-		
-		start_record(io_gc, "Share Conversion");
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				bool* index_mask_buffer = new bool[LUT_INPUT_SIZE+1];
-				for (int i = 0; i < LUT_INPUT_SIZE+1; i++) 
-					index_mask_buffer[i] = batch_server->index_masks[hash_idx][bucket_idx][i];
-				A_index[hash_idx][bucket_idx].bits.resize(LUT_INPUT_SIZE+1);
-				prot_exec->feed((block128 *)A_index[hash_idx][bucket_idx].bits.data(), ALICE, index_mask_buffer, LUT_INPUT_SIZE+1); 
-				delete[] index_mask_buffer;
-
-				bool* entry_mask_buffer = new bool[LUT_OUTPUT_SIZE];
-				for (int i = 0; i < LUT_OUTPUT_SIZE; i++) 
-					entry_mask_buffer[i] = batch_server->entry_masks[hash_idx][bucket_idx][i];
-				A_entry[hash_idx][bucket_idx].bits.resize(LUT_OUTPUT_SIZE);
-				prot_exec->feed((block128 *)A_entry[hash_idx][bucket_idx].bits.data(), ALICE, entry_mask_buffer, LUT_OUTPUT_SIZE); 
-				delete[] entry_mask_buffer;
-			}
-		}
-
-		int total_length = w * num_bucket * datablock_size;
-		bool* b = new bool[total_length];
-		std::fill(b, b + total_length, false);
-		vector<Bit> bits(total_length);
-		prot_exec->feed((block128 *)bits.data(), BOB, b, total_length); 
-		delete[] b;
-
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-				auto start_it = bits.begin() + (hash_idx * num_bucket * datablock_size + bucket_idx * datablock_size);
-				B_index[hash_idx][bucket_idx].bits = vector<Bit>(start_it, start_it + DatabaseConstants::InputLength);
-				B_entry[hash_idx][bucket_idx].bits = vector<Bit>(start_it + DatabaseConstants::InputLength, start_it + datablock_size);
-			}
-		}
+		share = answer_queries(lut_params, query_buffers, verbose);
 	}
+	share_conversion(lut_params, share, index, entry, verbose);
 
-	for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
-		for (int hash_idx = 0; hash_idx < w; hash_idx++) {
-			index[hash_idx][bucket_idx] = A_index[hash_idx][bucket_idx] ^ B_index[hash_idx][bucket_idx];
-			entry[hash_idx][bucket_idx] = A_entry[hash_idx][bucket_idx] ^ B_entry[hash_idx][bucket_idx];
-		}
-	}
-	end_record(io_gc, "Share Conversion", verbose);
-	
 	// Gen Context is fused to above
 
 	// Collect result
 	start_record(io_gc, "Result Collection");
-	auto zero_index = Integer(LUT_INPUT_SIZE+1, 0);
-	secret_queries.resize(num_bucket, zero_index);
-	permute(sort_res, secret_queries);
-
-	auto zero_entry = Integer(LUT_OUTPUT_SIZE, 0);
-	IntegerArray result(num_bucket, zero_entry);
-	for(int bucket_idx = 0; bucket_idx < num_bucket; ++bucket_idx) {
-		auto selected_query = secret_queries[bucket_idx];
-		
-		for (int hash_idx = 0; hash_idx < w; ++hash_idx) {
-			result[bucket_idx] = result[bucket_idx] ^ If(selected_query == index[hash_idx][bucket_idx], entry[hash_idx][bucket_idx], zero_entry);
-		}
-	}
-
-	permute(sort_res, result, true);
+	auto result = collect_result(secret_queries, sort_res, index, entry, num_bucket);
 	end_record(io_gc, "Result Collection");
 	end_record(io_gc, "Share Retrieval + Decode", verbose);
-	
+
 	// Remapping
 	start_record(io_gc, "Mapping");
 	remap(result, context);
 	end_record(io_gc, "Mapping", verbose);
-	
-	if (party == ALICE) {
-		delete batch_server;
-	} else {
-		delete batch_client;
-	}
-	delete prng;
-	delete params;
-	delete config;
-	if (hash_type == HashType::LowMC) {
-		delete lowmc_ciphers_2PC;
-	} else {
-		delete aes_ciphers_2PC;
-	}
-    
+
+	release(lut_params);
+
     return result;
 }
 
-} // namespace sci
\ No newline at end of file
+vector<uint64_t> fable_lookup_xor(const vector<uint64_t>& query_shares, FABLEParams& lut_params, bool fuse, bool verbose) {
+	utils::check(LUT_OUTPUT_SIZE <= 64, fmt::format("[FABLE] Results of {} bits do not fit in XOR-shared words. ", LUT_OUTPUT_SIZE));
+	auto io_gc = lut_params.io_gc;
+
+	start_record(io_gc, "Input Sharing");
+	auto secret_queries = from_xor_shares(query_shares, DatabaseConstants::InputLength + 1, lut_params.party);
+	end_record(io_gc, "Input Sharing", verbose);
+
+	auto result = fuse ? fable_lookup_fuse(secret_queries, lut_params, verbose) : fable_lookup(secret_queries, lut_params, verbose);
+	return to_xor_shares(result);
+}
+
+} // namespace sci
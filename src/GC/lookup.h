@@ -11,6 +11,8 @@
 #include "custom_types.h"
 #include "batchpirserver.h"
 #include "batchpirclient.h"
+#include "pir_channel.h"
+#include "shard.h"
 #include <set>
 
 namespace sci {
@@ -27,6 +29,8 @@ struct FABLEParams{
     BatchPIRServer* batch_server; 
     BatchPIRClient* batch_client;
     NetIO *io_gc; 
+    int num_shards;
+    PIRShardCoordinator* shards; // ALICE only; nullptr if the LUT is served in-process
 }; 
 
 inline void barrier(int party, sci::NetIO* io_gc) {
@@ -49,9 +53,10 @@ Integer share_bitset(std::bitset<size> bits, int party) {
 	return res;
 }
 
-FABLEParams fable_prepare(vector<uint64_t>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, int type, int hash_type, NetIO *io_gc);
+// With shard_opts.num_shards > 1, ALICE serves the LUT from num_shards pirshard workers (see shard.h). Both parties must pass the same num_shards. 
+FABLEParams fable_prepare(vector<uint64_t>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, int type, int hash_type, NetIO *io_gc, ShardOptions shard_opts = ShardOptions());
 
-FABLEParams fable_prepare(map<uint64_t, uint64_t>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, int type, int hash_type, NetIO *io_gc); 
+FABLEParams fable_prepare(map<uint64_t, uint64_t>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, int type, int hash_type, NetIO *io_gc, ShardOptions shard_opts = ShardOptions()); 
 
 FABLEParams fable_prepare(map<uint64_t, rawdatablock>& lut, int party, int batch_size, int db_size, bool parallel, int num_threads, BatchPirType type, HashType hash_type, NetIO *io_gc); 
 
@@ -59,5 +64,10 @@ IntegerArray fable_lookup(IntegerArray secret_queries, FABLEParams& lut_params,
 
 IntegerArray fable_lookup_fuse(IntegerArray secret_queries, FABLEParams& lut_params, bool verbose = false); 
 
+// Entry point for XOR-shared data: each party passes its XOR shares of the query words (less than 2^LUT_INPUT_SIZE),
+// which are fed into the circuit with a single feed per party, and gets back its XOR shares of the results.
+// Needs LUT_OUTPUT_SIZE <= 64.
+vector<uint64_t> fable_lookup_xor(const vector<uint64_t>& query_shares, FABLEParams& lut_params, bool fuse = false, bool verbose = false);
+
 } // namespace sci
 #endif
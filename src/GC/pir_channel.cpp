@@ -0,0 +1,182 @@
+#include "pir_channel.h"
+#include <atomic>
+#include <stdexcept>
+#include <fmt/format.h>
+#include "seal/serialization.h"
+
+namespace sci {
+
+static std::atomic<uint64_t> num_query_ciphertexts{0}, num_response_ciphertexts{0}, num_saved_bytes{0};
+static std::atomic<PIRCompression> compression{PIRCompression::none};
+
+const uint32_t COMPRESSED_FLAG = 1U << 31;
+
+uint64_t pir_query_ciphertexts() {
+	return num_query_ciphertexts;
+}
+
+uint64_t pir_response_ciphertexts() {
+	return num_response_ciphertexts;
+}
+
+uint64_t pir_compression_saved_bytes() {
+	return num_saved_bytes;
+}
+
+// PIRCompression shares its values with seal::compr_mode_type, whose members depend on how SEAL was built
+void set_pir_compression(PIRCompression mode) {
+	if (!seal::Serialization::IsSupportedComprMode(static_cast<uint8_t>(mode)))
+		throw std::invalid_argument(fmt::format("[PIR] SEAL was built without compression mode {}. ", (int)mode));
+	compression = mode;
+}
+
+PIRCompression get_pir_compression() {
+	return compression;
+}
+
+// Wraps (size, bytes) in SEAL's compressed serialization. Returns false if that does not shrink the buffer.
+static bool compress(const std::vector<seal::seal_byte>& buf, std::vector<seal::seal_byte>& out, PIRCompression compr_mode) {
+	auto mode = static_cast<seal::compr_mode_type>(compr_mode);
+	uint64_t raw_size = buf.size();
+	std::streamoff members_size = sizeof(raw_size) + raw_size;
+	out.resize(sizeof(seal::Serialization::SEALHeader) + seal::Serialization::ComprSizeEstimate(members_size, mode));
+	auto out_size = seal::Serialization::Save([&](std::ostream& stream) {
+		stream.write(reinterpret_cast<const char*>(&raw_size), sizeof(raw_size));
+		stream.write(reinterpret_cast<const char*>(buf.data()), raw_size);
+	}, members_size, out.data(), out.size(), mode, false);
+	if ((uint64_t)out_size >= raw_size)
+		return false;
+	out.resize(out_size);
+	return true;
+}
+
+static std::vector<seal::seal_byte> decompress(const std::vector<seal::seal_byte>& in) {
+	std::vector<seal::seal_byte> buf;
+	seal::Serialization::Load([&](std::istream& stream, seal::SEALVersion) {
+		uint64_t raw_size;
+		stream.read(reinterpret_cast<char*>(&raw_size), sizeof(raw_size));
+		buf.resize(raw_size);
+		stream.read(reinterpret_cast<char*>(buf.data()), raw_size);
+	}, in.data(), in.size(), false);
+	return buf;
+}
+
+static void send_wire(NetIO* io, const std::vector<seal::seal_byte>& buf, bool compressed) {
+	utils::check(buf.size() < COMPRESSED_FLAG, fmt::format("[PIR] A buffer of {} bytes does not fit the 31-bit length on the wire. ", buf.size()));
+	uint32_t buf_size = buf.size() | (compressed ? COMPRESSED_FLAG : 0);
+	io->send_data(&buf_size, sizeof(uint32_t));
+	io->send_data(buf.data(), buf.size());
+}
+
+static std::vector<seal::seal_byte> recv_wire(NetIO* io, bool& compressed) {
+	uint32_t buf_size;
+	io->recv_data(&buf_size, sizeof(uint32_t));
+	compressed = buf_size & COMPRESSED_FLAG;
+	std::vector<seal::seal_byte> buf(buf_size & ~COMPRESSED_FLAG);
+	io->recv_data(buf.data(), buf.size());
+	return buf;
+}
+
+// Compresses the buffers in parallel, then sends them in order
+static void send_buffers(NetIO* io, const std::vector<const std::vector<seal::seal_byte>*>& bufs, PIRCompression mode) {
+	std::vector<std::vector<seal::seal_byte>> compressed(bufs.size());
+	std::vector<uint8_t> is_compressed(bufs.size(), 0);
+	if (mode != PIRCompression::none) {
+		#pragma omp parallel for schedule(dynamic)
+		for (size_t i = 0; i < bufs.size(); i++)
+			is_compressed[i] = compress(*bufs[i], compressed[i], mode);
+	}
+	for (size_t i = 0; i < bufs.size(); i++) {
+		if (is_compressed[i]) {
+			num_saved_bytes += bufs[i]->size() - compressed[i].size();
+			send_wire(io, compressed[i], true);
+		} else {
+			send_wire(io, *bufs[i], false);
+		}
+	}
+}
+
+// Receives the buffers in order, then decompresses them in parallel
+static void recv_buffers(NetIO* io, const std::vector<std::vector<seal::seal_byte>*>& bufs) {
+	std::vector<uint8_t> is_compressed(bufs.size(), 0);
+	for (size_t i = 0; i < bufs.size(); i++) {
+		bool compressed;
+		*bufs[i] = recv_wire(io, compressed);
+		is_compressed[i] = compressed;
+	}
+	#pragma omp parallel for schedule(dynamic)
+	for (size_t i = 0; i < bufs.size(); i++) {
+		if (!is_compressed[i])
+			continue;
+		auto buf = decompress(*bufs[i]);
+		num_saved_bytes += buf.size() - bufs[i]->size();
+		*bufs[i] = std::move(buf);
+	}
+}
+
+void send_bytes(NetIO* io, const std::vector<seal::seal_byte>& buf, PIRCompression mode) {
+	send_buffers(io, {&buf}, mode);
+}
+
+std::vector<seal::seal_byte> recv_bytes(NetIO* io) {
+	std::vector<seal::seal_byte> buf;
+	recv_buffers(io, {&buf});
+	return buf;
+}
+
+void send_query(NetIO* io, BatchPirParams* params, QueryBuffer& query_buffer, PIRCompression mode) {
+	std::vector<const std::vector<seal::seal_byte>*> bufs;
+	for (int i = 0; i < params->query_size[0]; i++) {
+		for (int j = 0; j < params->query_size[1]; j++) {
+			for (int k = 0; k < params->query_size[2]; k++) {
+				bufs.push_back(&query_buffer[i][j][k]);
+			}
+		}
+	}
+	send_buffers(io, bufs, mode);
+	num_query_ciphertexts += bufs.size();
+}
+
+QueryBuffer recv_query(NetIO* io, BatchPirParams* params) {
+	QueryBuffer query_buffer(params->query_size[0]);
+	std::vector<std::vector<seal::seal_byte>*> bufs;
+	for (int i = 0; i < params->query_size[0]; i++) {
+		query_buffer[i].resize(params->query_size[1]);
+		for (int j = 0; j < params->query_size[1]; j++) {
+			query_buffer[i][j].resize(params->query_size[2]);
+			for (int k = 0; k < params->query_size[2]; k++) {
+				bufs.push_back(&query_buffer[i][j][k]);
+			}
+		}
+	}
+	recv_buffers(io, bufs);
+	num_query_ciphertexts += bufs.size();
+	return query_buffer;
+}
+
+void send_response(NetIO* io, BatchPirParams* params, ResponseBuffer& response_buffer, PIRCompression mode) {
+	std::vector<const std::vector<seal::seal_byte>*> bufs;
+	for (int i = 0; i < params->response_size[0]; i++) {
+		for (int j = 0; j < params->response_size[1]; j++) {
+			bufs.push_back(&response_buffer[i][j]);
+		}
+	}
+	send_buffers(io, bufs, mode);
+	num_response_ciphertexts += bufs.size();
+}
+
+ResponseBuffer recv_response(NetIO* io, BatchPirParams* params) {
+	ResponseBuffer response_buffer(params->response_size[0]);
+	std::vector<std::vector<seal::seal_byte>*> bufs;
+	for (int i = 0; i < params->response_size[0]; i++) {
+		response_buffer[i].resize(params->response_size[1]);
+		for (int j = 0; j < params->response_size[1]; j++) {
+			bufs.push_back(&response_buffer[i][j]);
+		}
+	}
+	recv_buffers(io, bufs);
+	num_response_ciphertexts += bufs.size();
+	return response_buffer;
+}
+
+} // namespace sci
@@ -0,0 +1,63 @@
+#ifndef FABLE_PIR_CHANNEL_H__
+#define FABLE_PIR_CHANNEL_H__
+
+#include <bitset>
+#include <cstdint>
+#include <vector>
+#include "utils/net_io_channel.h"
+#include "batchpirserver.h"
+
+namespace sci {
+
+// Serialized PIR messages, indexed as params->query_size / params->response_size
+typedef std::vector<std::vector<std::vector<std::vector<seal::seal_byte>>>> QueryBuffer;
+typedef std::vector<std::vector<std::vector<seal::seal_byte>>> ResponseBuffer;
+
+// Compression of the PIR buffers on the wire, using SEAL's compressors. Only the sender's mode matters: every
+// buffer carries whether it is compressed, and buffers that would not shrink are sent as they are.
+// Off by default: ciphertext coefficients are uniform modulo their primes, and SEAL's serialization already
+// compresses them (zstd when SEAL is built with it), so a second pass is not expected to save anything.
+enum class PIRCompression { none = 0, zlib = 1, zstd = 2 };
+
+// Process-wide default mode of send_bytes / send_query / send_response. Throws if SEAL was built without it.
+void set_pir_compression(PIRCompression mode);
+PIRCompression get_pir_compression();
+
+// Each ciphertext buffer is sent as a uint32_t length followed by its bytes. The top bit of the length marks a
+// compressed buffer, so a buffer must be smaller than 2 GiB. Query and response buffers are (de)compressed in parallel, one ciphertext per task.
+void send_query(NetIO* io, BatchPirParams* params, QueryBuffer& query_buffer, PIRCompression mode = get_pir_compression());
+QueryBuffer recv_query(NetIO* io, BatchPirParams* params);
+
+void send_response(NetIO* io, BatchPirParams* params, ResponseBuffer& response_buffer, PIRCompression mode = get_pir_compression());
+ResponseBuffer recv_response(NetIO* io, BatchPirParams* params);
+
+void send_bytes(NetIO* io, const std::vector<seal::seal_byte>& buf, PIRCompression mode = get_pir_compression());
+std::vector<seal::seal_byte> recv_bytes(NetIO* io);
+
+// Number of query / response ciphertexts sent or received by this process so far
+uint64_t pir_query_ciphertexts();
+uint64_t pir_response_ciphertexts();
+
+// Bytes saved on the wire by compressing PIR buffers, sent or received by this process so far
+uint64_t pir_compression_saved_bytes();
+
+template<size_t size>
+void send_bitset(NetIO* io, const std::bitset<size>& bits) {
+	bool buf[size];
+	for (size_t i = 0; i < size; i++)
+		buf[i] = bits[i];
+	io->send_data(buf, size);
+}
+
+template<size_t size>
+std::bitset<size> recv_bitset(NetIO* io) {
+	bool buf[size];
+	io->recv_data(buf, size);
+	std::bitset<size> bits;
+	for (size_t i = 0; i < size; i++)
+		bits[i] = buf[i];
+	return bits;
+}
+
+} // namespace sci
+#endif
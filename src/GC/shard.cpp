@@ -0,0 +1,315 @@
+#include "shard.h"
+#include "utils/io_utils.h"
+#include "utils/numa_utils.h"
+#include <fmt/core.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+extern char **environ;
+
+namespace sci {
+
+const int SHARD_POLL_MS = 10;
+const int SHARD_EXIT_TIMEOUT_MS = 10000;
+
+std::vector<uint64_t> ShardRouter::count(const std::vector<uint64_t>& lut) const {
+	std::vector<uint64_t> rows(num_shards, 0);
+	for (uint64_t x = 0; x < lut.size(); x++)
+		rows[shard(x)]++;
+	return rows;
+}
+
+std::vector<uint64_t> ShardRouter::count(const std::map<uint64_t, uint64_t>& lut) const {
+	std::vector<uint64_t> rows(num_shards, 0);
+	for (auto& [x, value] : lut)
+		rows[shard(x)]++;
+	return rows;
+}
+
+// A shard receives Binomial(n, 1/k) queries, with mean mu = n/k. By Bernstein's inequality it receives mu + t or more
+// with probability at most exp(-t^2 / (2 (mu + t/3))), which is 2^-40 / k for the t below.
+uint64_t shard_batch_size(uint64_t batch_size, int num_shards) {
+	if (num_shards == 1)
+		return batch_size;
+	double mu = (double)batch_size / num_shards, lambda = 40 * std::log(2.0) + std::log((double)num_shards);
+	double margin = lambda / 3 + std::sqrt(lambda * lambda / 9 + 2 * mu * lambda);
+	return std::min<uint64_t>(batch_size, (uint64_t)std::ceil(mu + margin));
+}
+
+static std::string describe_status(int status) {
+	if (WIFEXITED(status))
+		return fmt::format("exit code {}", WEXITSTATUS(status));
+	if (WIFSIGNALED(status))
+		return fmt::format("signal {}", WTERMSIG(status));
+	return "unknown status";
+}
+
+static int connect_loopback(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Rows answered by the shards of every NUMA node, and the time of the slowest of them, summed over all answers.
+// Registered as numa<node>_rows and numa<node>_answer_us counters, whose ratio over a record is the node's throughput.
+struct NodeStats {
+	std::atomic<uint64_t> rows{0}, answer_us{0};
+};
+
+static NodeStats& node_stats(int node) {
+	static std::mutex mutex;
+	static std::map<int, NodeStats> stats;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto [it, inserted] = stats.try_emplace(node);
+	NodeStats* node_stats = &it->second;
+	if (inserted) {
+		register_counter(fmt::format("numa{}_rows", node), [node_stats]() { return node_stats->rows.load(); });
+		register_counter(fmt::format("numa{}_answer_us", node), [node_stats]() { return node_stats->answer_us.load(); });
+	}
+	return *node_stats;
+}
+
+static std::string default_worker_path() {
+	char buf[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+	utils::check(len > 0, "[Shard] Cannot locate the running executable. ");
+	std::string exe(buf, len);
+	return exe.substr(0, exe.find_last_of('/')) + "/pirshard";
+}
+
+PIRShardCoordinator::PIRShardCoordinator(const ShardOptions& opts, BatchPirParams* params, ShardSpec spec, const ShardRouter& router) : spec(spec), params(params), shard_router(router) {
+	std::string worker = opts.worker.empty() ? default_worker_path() : opts.worker;
+
+	// Bound workers pin each OpenMP thread to a core of their node
+	std::vector<std::string> env_strings;
+	for (char** env = environ; *env; env++)
+		env_strings.push_back(*env);
+	if (opts.numa) {
+		env_strings.push_back("OMP_PLACES=cores");
+		env_strings.push_back("OMP_PROC_BIND=close");
+	}
+	std::vector<char*> envp;
+	for (auto& env : env_strings)
+		envp.push_back((char*)env.c_str());
+	envp.push_back(nullptr);
+
+	auto online_nodes = numa_online_nodes();
+	for (int shard_idx = 0; shard_idx < opts.num_shards; shard_idx++) {
+		nodes.push_back(opts.numa ? online_nodes[shard_idx % online_nodes.size()] : -1);
+		if (opts.numa)
+			node_stats(nodes.back());
+		std::string port_arg = fmt::format("p={}", opts.port + SHARD_PORT_OFFSET + shard_idx);
+		std::string node_arg = fmt::format("node={}", nodes.back());
+		char* argv[] = {(char*)worker.c_str(), (char*)"127.0.0.1", (char*)port_arg.c_str(), (char*)node_arg.c_str(), nullptr};
+		pid_t pid;
+		if (posix_spawn(&pid, worker.c_str(), nullptr, nullptr, argv, envp.data()) != 0) {
+			kill_workers();
+			utils::check(false, fmt::format("[Shard] Cannot spawn {}. ", worker));
+		}
+		pids.push_back(pid);
+	}
+	connect_workers(opts.port);
+}
+
+// NetIO only accepts blocking, so every connection is accepted on its own thread while the workers are polled.
+// A worker that exits before connecting (bad path, port in use, crash) fails the coordinator instead of hanging it.
+void PIRShardCoordinator::connect_workers(int port) {
+	int n = pids.size();
+	ios.assign(n, nullptr);
+	std::unique_ptr<std::atomic<bool>[]> connected(new std::atomic<bool>[n]());
+	std::vector<std::thread> acceptors;
+	for (int shard_idx = 0; shard_idx < n; shard_idx++) {
+		acceptors.emplace_back([this, &connected, port, shard_idx]() {
+			ios[shard_idx] = new NetIO(nullptr, port + SHARD_PORT_OFFSET + shard_idx, true);
+			connected[shard_idx] = true;
+		});
+	}
+
+	std::string failure;
+	auto all_connected = [&]() {
+		for (int shard_idx = 0; shard_idx < n; shard_idx++)
+			if (!connected[shard_idx])
+				return false;
+		return true;
+	};
+	while (failure.empty() && !all_connected()) {
+		for (int shard_idx = 0; shard_idx < n && failure.empty(); shard_idx++) {
+			int status;
+			if (!connected[shard_idx] && waitpid(pids[shard_idx], &status, WNOHANG) == pids[shard_idx]) {
+				pids[shard_idx] = -1;
+				failure = fmt::format("[Shard] Worker {} exited before connecting ({}). ", shard_idx, describe_status(status));
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(SHARD_POLL_MS));
+	}
+
+	if (!failure.empty()) {
+		kill_workers();
+		// Wake up the acceptors that are still waiting, so that they can be joined
+		for (int shard_idx = 0; shard_idx < n; shard_idx++) {
+			while (!connected[shard_idx]) {
+				int fd = connect_loopback(port + SHARD_PORT_OFFSET + shard_idx);
+				if (fd >= 0)
+					close(fd);
+				std::this_thread::sleep_for(std::chrono::milliseconds(SHARD_POLL_MS));
+			}
+		}
+	}
+	for (auto& acceptor : acceptors)
+		acceptor.join();
+	if (!failure.empty()) {
+		for (auto io : ios)
+			delete io;
+		ios.clear();
+	}
+	utils::check(failure.empty(), failure);
+}
+
+void PIRShardCoordinator::kill_workers() {
+	for (auto& pid : pids) {
+		if (pid <= 0)
+			continue;
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+		pid = -1;
+	}
+}
+
+PIRShardCoordinator::~PIRShardCoordinator() {
+	for (auto io : ios)
+		delete io;
+	// Workers exit once they have sent their answer; one that is still running after the grace period is killed
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHARD_EXIT_TIMEOUT_MS);
+	for (size_t shard_idx = 0; shard_idx < pids.size(); shard_idx++) {
+		if (pids[shard_idx] <= 0)
+			continue;
+		int status = 0;
+		pid_t exited;
+		while ((exited = waitpid(pids[shard_idx], &status, WNOHANG)) == 0 && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(SHARD_POLL_MS));
+		if (exited == 0) {
+			std::cerr << fmt::format("[Shard] Worker {} did not exit; killing it. ", shard_idx) << std::endl;
+			continue;
+		}
+		if (exited == pids[shard_idx] && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+			std::cerr << fmt::format("[Shard] Worker {} failed ({}). ", shard_idx, describe_status(status)) << std::endl;
+		pids[shard_idx] = -1;
+	}
+	kill_workers();
+}
+
+void PIRShardCoordinator::send_rows(int shard_idx, const uint64_t* keys, const uint64_t* values, uint64_t num_rows) {
+	auto io = ios[shard_idx];
+	rows.push_back(num_rows);
+	ShardSpec shard_spec = spec;
+	shard_spec.num_rows = num_rows;
+	io->send_data(&shard_spec, sizeof(ShardSpec));
+	for (uint64_t begin = 0; begin < num_rows; begin += SHARD_ROW_CHUNK) {
+		uint64_t count = std::min(SHARD_ROW_CHUNK, num_rows - begin);
+		io->send_data(keys + begin, count * sizeof(uint64_t));
+		io->send_data(values + begin, count * sizeof(uint64_t));
+	}
+	io->flush();
+}
+
+void PIRShardCoordinator::populate(const std::vector<uint64_t>& lut) {
+	std::vector<std::vector<uint64_t>> keys(num_shards()), values(num_shards());
+	for (uint64_t x = 0; x < lut.size(); x++) {
+		int shard_idx = shard_router.shard(x);
+		keys[shard_idx].push_back(x);
+		values[shard_idx].push_back(lut[x]);
+	}
+	for (int shard_idx = 0; shard_idx < num_shards(); shard_idx++)
+		send_rows(shard_idx, keys[shard_idx].data(), values[shard_idx].data(), keys[shard_idx].size());
+}
+
+void PIRShardCoordinator::populate(const std::map<uint64_t, uint64_t>& lut) {
+	std::vector<std::vector<uint64_t>> keys(num_shards()), values(num_shards());
+	for (auto& [x, value] : lut) {
+		int shard_idx = shard_router.shard(x);
+		keys[shard_idx].push_back(x);
+		values[shard_idx].push_back(value);
+	}
+	for (int shard_idx = 0; shard_idx < num_shards(); shard_idx++)
+		send_rows(shard_idx, keys[shard_idx].data(), values[shard_idx].data(), keys[shard_idx].size());
+}
+
+void PIRShardCoordinator::set_client_keys(const std::vector<seal::seal_byte>& glk_buffer, const std::vector<seal::seal_byte>& rlk_buffer) {
+	for (auto io : ios) {
+		send_bytes(io, glk_buffer, PIRCompression::none);
+		send_bytes(io, rlk_buffer, PIRCompression::none);
+		io->flush();
+	}
+}
+
+void PIRShardCoordinator::prepare(const keyblock& lowmc_key, const prefixblock& lowmc_prefix) {
+	for (auto io : ios) {
+		send_bitset(io, lowmc_key);
+		send_bitset(io, lowmc_prefix);
+		io->flush();
+	}
+}
+
+void PIRShardCoordinator::prepare(const oc::block& aes_key, const std::bitset<128-DatabaseConstants::InputLength>& aes_prefix) {
+	for (auto io : ios) {
+		io->send_data(&aes_key, sizeof(oc::block));
+		send_bitset(io, aes_prefix);
+		io->flush();
+	}
+}
+
+std::vector<ShardAnswer> PIRShardCoordinator::answer(std::vector<QueryBuffer>& query_buffers) {
+	for (int shard_idx = 0; shard_idx < num_shards(); shard_idx++) {
+		send_query(ios[shard_idx], params, query_buffers[shard_idx], PIRCompression::none);
+		ios[shard_idx]->flush();
+	}
+	const int w = DatabaseConstants::NumHashFunctions;
+	std::vector<ShardAnswer> answers(num_shards());
+	for (int shard_idx = 0; shard_idx < num_shards(); shard_idx++) {
+		auto io = ios[shard_idx];
+		answers[shard_idx].response = recv_response(io, params);
+		answers[shard_idx].masks.resize(w * params->get_num_buckets() * datablock_size);
+		io->recv_data(answers[shard_idx].masks.data(), answers[shard_idx].masks.size());
+		io->recv_data(&answers[shard_idx].answer_ms, sizeof(double));
+		answers[shard_idx].node = nodes[shard_idx];
+		answers[shard_idx].num_rows = rows[shard_idx];
+	}
+
+	// The shards of a node answer in parallel, so the node takes as long as its slowest shard
+	std::map<int, std::pair<uint64_t, double>> node_answers;
+	for (auto& answer : answers) {
+		if (answer.node < 0)
+			continue;
+		auto& [node_rows, node_ms] = node_answers[answer.node];
+		node_rows += answer.num_rows;
+		node_ms = std::max(node_ms, answer.answer_ms);
+	}
+	for (auto& [node, stats] : node_answers) {
+		node_stats(node).rows += stats.first;
+		node_stats(node).answer_us += (uint64_t)(stats.second * 1e3);
+	}
+	return answers;
+}
+
+} // namespace sci
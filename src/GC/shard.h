@@ -0,0 +1,113 @@
+#ifndef FABLE_SHARD_H__
+#define FABLE_SHARD_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <cryptoTools/Crypto/AES.h>
+#include "pir_channel.h"
+#include "lowmc.h"
+
+namespace sci {
+
+// Shard s of a sharded LUT is served by a pirshard worker connected to port + SHARD_PORT_OFFSET + s
+const int SHARD_PORT_OFFSET = 200;
+// Rows are streamed to the workers in chunks of this many keys and values
+const uint64_t SHARD_ROW_CHUNK = 1ULL << 16;
+
+struct ShardOptions {
+	int num_shards = 1;
+	int port = 8000;
+	std::string worker = ""; // Path to the pirshard executable. Default: next to the running executable.
+	bool numa = false;       // Place shard s on the (s % #nodes)-th online NUMA node, with its threads and memory bound to that
+	                         // node; a single in-process shard is bound to the first online node. Binding failures are errors.
+};
+
+// Sent by the coordinator before the shard rows. batch_size and db_size are those of a single shard.
+struct ShardSpec {
+	uint64_t batch_size, db_size, num_rows;
+	int32_t parallel, num_threads, type, hash_type;
+};
+
+// Index mask bits followed by entry mask bits, for every (hash function, bucket)
+typedef std::vector<uint8_t> MaskBits;
+
+struct ShardAnswer {
+	ResponseBuffer response;
+	MaskBits masks;
+	double answer_ms;
+	int node;          // NUMA node of the worker, or -1
+	uint64_t num_rows; // LUT rows held by the worker
+};
+
+// Rows and queries are split between the shards by a PRF keyed by ALICE: key x goes to shard AES_key(x) mod num_shards,
+// with x zero-extended to a block. BOB learns the shard of each of his queries by evaluating the PRF in GC. 
+class ShardRouter {
+public:
+	ShardRouter(const oc::block& key, int num_shards) : key(key), num_shards(num_shards), aes(key) {}
+
+	int shard(uint64_t x) const {
+		return aes.ecbEncBlock(oc::block(0, x)).get<uint64_t>()[0] % num_shards;
+	}
+
+	// Rows of every shard
+	std::vector<uint64_t> count(const std::vector<uint64_t>& lut) const;
+	std::vector<uint64_t> count(const std::map<uint64_t, uint64_t>& lut) const;
+
+	oc::block key;
+	int num_shards;
+
+private:
+	oc::AES aes;
+};
+
+// Queries per shard: a num_shards-th of the batch, plus the margin that the busiest shard exceeds with probability
+// below 2^-40 (a Chernoff bound, with a union bound over the shards). The whole batch without sharding.
+uint64_t shard_batch_size(uint64_t batch_size, int num_shards);
+
+// Runs on ALICE. The LUT rows are routed by a ShardRouter into num_shards shards, each encoded by its own
+// BatchPIRServer, built for shard_batch_size queries, in a separate pirshard process. BOB routes his queries the same
+// way, so every shard answers only the queries that can hit its rows: the buckets of the shards are concatenated in
+// Decode, and the response ciphertexts, the shared masks and the Decode slots stay those of one lookup of the whole
+// batch, plus the margin of shard_batch_size and the rounding of every shard's buckets to whole ciphertexts. 
+class PIRShardCoordinator {
+public:
+	// Spawns the workers and waits until all of them are connected. params and spec must describe a single shard,
+	// i.e., shard_batch_size queries into the rows of the largest shard.
+	// Throws, after killing the other workers, if a worker exits before connecting.
+	PIRShardCoordinator(const ShardOptions& opts, BatchPirParams* params, ShardSpec spec, const ShardRouter& router);
+	// Reports workers that failed, and kills those still running after a grace period
+	~PIRShardCoordinator();
+
+	void populate(const std::vector<uint64_t>& lut);
+	void populate(const std::map<uint64_t, uint64_t>& lut);
+
+	void set_client_keys(const std::vector<seal::seal_byte>& glk_buffer, const std::vector<seal::seal_byte>& rlk_buffer);
+
+	// Workers start their server setup as soon as they receive the OPRF key
+	void prepare(const keyblock& lowmc_key, const prefixblock& lowmc_prefix);
+	void prepare(const oc::block& aes_key, const std::bitset<128-DatabaseConstants::InputLength>& aes_prefix);
+
+	// Shard s answers query_buffers[s]
+	std::vector<ShardAnswer> answer(std::vector<QueryBuffer>& query_buffers);
+
+	int num_shards() const { return ios.size(); }
+	const ShardRouter& router() const { return shard_router; }
+
+private:
+	void connect_workers(int port);
+	void kill_workers();
+	void send_rows(int shard_idx, const uint64_t* keys, const uint64_t* values, uint64_t num_rows);
+
+	ShardSpec spec;
+	BatchPirParams* params;
+	ShardRouter shard_router;
+	std::vector<NetIO*> ios;
+	std::vector<pid_t> pids;
+	std::vector<int> nodes;
+	std::vector<uint64_t> rows;
+};
+
+} // namespace sci
+#endif
@@ -0,0 +1,114 @@
+#ifndef FABLE_SHARE_H__
+#define FABLE_SHARE_H__
+
+#include <bitset>
+#include <cstdint>
+#include <vector>
+#include <fmt/core.h>
+#include "GC/emp-sh2pc.h"
+#include "custom_types.h"
+#include "utils/io_utils.h"
+
+namespace sci {
+
+// Batched input and output of GC tables. Tables are column-major: table[c][r] is row r of column c, and every value of
+// column c is widths[c] <= 64 bits wide. Only src_party's values are read, but both parties must pass tables of the same shape.
+//
+// A table is fed with a single feed (one OT batch if src_party is BOB) into one contiguous label buffer, and every
+// Integer takes its labels from there. Integers own their labels, so this is one copy of the labels, not one feed per value.
+template<typename T>
+std::vector<IntegerArray> share_table(const std::vector<std::vector<T>>& table, const std::vector<int>& widths, int src_party, int party) {
+	utils::check(table.size() == widths.size(), "[Share] Every column needs a width. ");
+	size_t total_length = 0;
+	for (size_t c = 0; c < table.size(); c++) {
+		utils::check(widths[c] > 0 && widths[c] <= 64, fmt::format("[Share] Columns of {} bits are not supported. ", widths[c]));
+		total_length += table[c].size() * widths[c];
+	}
+
+	std::vector<uint8_t> buffer(total_length, 0);
+	if (party == src_party) {
+		size_t offset = 0;
+		for (size_t c = 0; c < table.size(); c++) {
+			for (auto& value : table[c]) {
+				for (int j = 0; j < widths[c]; j++)
+					buffer[offset + j] = ((uint64_t)value >> j) & 1;
+				offset += widths[c];
+			}
+		}
+	}
+	std::vector<Bit> labels(total_length);
+	prot_exec->feed((block128 *)labels.data(), src_party, (bool*)buffer.data(), total_length);
+
+	std::vector<IntegerArray> secret(table.size());
+	auto label = labels.begin();
+	for (size_t c = 0; c < table.size(); c++) {
+		secret[c].resize(table[c].size());
+		for (auto& value : secret[c]) {
+			value.bits.assign(label, label + widths[c]);
+			label += widths[c];
+		}
+	}
+	return secret;
+}
+
+template<typename T>
+IntegerArray share_column(const std::vector<T>& column, int width, int src_party, int party) {
+	return share_table(std::vector<std::vector<T>>{column}, {width}, src_party, party)[0];
+}
+
+// Reveals a whole table to to_party (or PUBLIC) with a single reveal. The other party gets zeros.
+template<typename T = uint64_t>
+std::vector<std::vector<T>> reveal_table(const std::vector<IntegerArray>& table, int to_party, int party) {
+	size_t total_length = 0;
+	for (auto& column : table)
+		for (auto& value : column)
+			total_length += value.size();
+
+	std::vector<Bit> labels;
+	labels.reserve(total_length);
+	for (auto& column : table)
+		for (auto& value : column)
+			labels.insert(labels.end(), value.bits.begin(), value.bits.end());
+	std::vector<uint8_t> buffer(total_length, 0);
+	prot_exec->reveal((bool*)buffer.data(), to_party, (block128 *)labels.data(), total_length);
+
+	std::vector<std::vector<T>> plain(table.size());
+	bool receives = to_party == PUBLIC || to_party == party;
+	size_t offset = 0;
+	for (size_t c = 0; c < table.size(); c++) {
+		plain[c].assign(table[c].size(), 0);
+		for (size_t r = 0; r < table[c].size(); r++) {
+			int width = table[c][r].size();
+			for (int j = 0; j < width && j < 64; j++)
+				if (receives && buffer[offset + j])
+					plain[c][r] |= (T)1 << j;
+			offset += width;
+		}
+	}
+	return plain;
+}
+
+template<typename T = uint64_t>
+std::vector<T> reveal_column(const IntegerArray& column, int to_party, int party) {
+	return reveal_table<T>(std::vector<IntegerArray>{column}, to_party, party)[0];
+}
+
+// Reveals packed bitsets to to_party (or PUBLIC) with a single reveal: bitset i holds labels[i * size + j] at position j.
+// The other party gets zeros.
+template<size_t size>
+std::vector<std::bitset<size>> reveal_bitsets(const std::vector<Bit>& labels, int to_party, int party) {
+	utils::check(labels.size() % size == 0, fmt::format("[Share] {} labels do not make {}-bit sets. ", labels.size(), size));
+	std::vector<uint8_t> buffer(labels.size(), 0);
+	prot_exec->reveal((bool*)buffer.data(), to_party, (block128 *)labels.data(), labels.size());
+
+	std::vector<std::bitset<size>> plain(labels.size() / size);
+	if (to_party != PUBLIC && to_party != party)
+		return plain;
+	for (size_t i = 0; i < plain.size(); i++)
+		for (size_t j = 0; j < size; j++)
+			plain[i][j] = buffer[i * size + j];
+	return plain;
+}
+
+} // namespace sci
+#endif
@@ -1,5 +1,14 @@
+#ifndef FABLE_LUT_UTILS_H__
+#define FABLE_LUT_UTILS_H__
+
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
 #include "utils/net_io_channel.h"
+#include <cryptoTools/Crypto/AES.h>
 #include <fmt/core.h>
 #include <stdexcept>
 #include "utils.h"
@@ -12,6 +21,9 @@ enum LUTType {
     NumLUTTypes
 };
 
+// Domain separator of the AES-CTR key used for Random LUTs
+const uint64_t LUT_GEN_DOMAIN = 0x464c5554ULL;
+
 // string representation of lut type
 inline std::string lut_type_to_string(LUTType lut_typ) {
     if (lut_typ == Random)
@@ -36,56 +48,177 @@ inline double itof(uint64_t x, long double fixedpoint_range, double input_range
 	return x * input_range / fixedpoint_range;
 }
 
+// Rows generated per AES call in fill_lut_rows; keeps the counter/ciphertext tiles on the stack
+const uint64_t LUT_GEN_TILE = 64;
+
+// Fill out[0, count) with rows [begin, begin + count) of the LUT. 
+// Random LUTs are drawn from AES-CTR keyed by the seed, so any row range can be generated independently and in parallel. 
+inline void fill_lut_rows(const LUTType lut_typ, uint64_t begin, uint64_t count, uint64_t lut_size, int seed, int output_bits, uint64_t* out) {
+	long double range = pow(2.0L, output_bits);
+	uint64_t out_mask = output_bits >= 64 ? UINT64_MAX : (1ULL << output_bits) - 1;
+	oc::AES prf(oc::block((uint64_t)LUT_GEN_DOMAIN, (uint64_t)(uint32_t)seed));
+
+	#pragma omp parallel for schedule(static)
+	for (uint64_t tile = 0; tile < count; tile += LUT_GEN_TILE) {
+		uint64_t tile_size = std::min(LUT_GEN_TILE, count - tile);
+		if (lut_typ == Random) {
+			std::array<oc::block, LUT_GEN_TILE> ctr, rnd;
+			for (uint64_t k = 0; k < tile_size; k++)
+				ctr[k] = oc::block(begin + tile + k);
+			prf.ecbEncBlocks(ctr.data(), tile_size, rnd.data());
+			for (uint64_t k = 0; k < tile_size; k++)
+				out[tile + k] = rnd[k].get<uint64_t>()[0] & out_mask;
+			continue;
+		}
+		for (uint64_t k = 0; k < tile_size; k++) {
+			uint64_t i = begin + tile + k;
+			if (lut_typ == Gamma) {
+				double input = (double)i/lut_size * 3 + 1; // from 1 to 4
+				out[tile + k] = ftoi(std::tgamma(input), range);
+			} else if (lut_typ == Filled) {
+				out[tile + k] = out_mask;
+			} else if (lut_typ == Cauchy_dis) {
+				double input = (double)i/lut_size * 80 - 40; // from -40 to 40
+				out[tile + k] = ftoi(1.0 / (M_PI * (1 + input * input)), range, 0.35);
+			}
+		}
+	}
+}
+
 inline std::vector<uint64_t> get_lut_vec(const LUTType lut_typ, uint64_t lut_size, int seed, int input_bits = LUT_INPUT_SIZE, int output_bits = LUT_OUTPUT_SIZE) {
-    long double range = pow(2.0L, output_bits);
+	if (lut_typ < 0 || lut_typ >= NumLUTTypes)
+		throw std::invalid_argument("LUT Type is not supported. ");
+	if (lut_size > (1ULL << input_bits))
+		throw std::invalid_argument("LUT size exceeds the input domain. ");
+
+	std::cout << "Start filling LUT content" << std::endl;
 	std::vector<uint64_t> lut(lut_size);
-	std::vector<double> abs_error(lut_size, 0);
-	std::vector<double> rel_error(lut_size, 0);
+	fill_lut_rows(lut_typ, 0, lut_size, lut_size, seed, output_bits, lut.data());
+	std::cout << "LUT built. " << std::endl;
+	return lut;
+}
 
-	std::vector<uint64_t> indices(1 << input_bits);
-	std::iota(indices.begin(), indices.end(), 0);
-	std::shuffle(indices.begin(), indices.end(), std::default_random_engine {});
-	indices.resize(lut_size);
-	
-	srand(seed);
+struct LUTErrorStats {
+	double max_abs_error, max_rel_error;
+};
 
-	std::cout << "Start filling LUT content" << std::endl;
-	#pragma omp parallel for if (lut_typ != Random)
-	for (uint64_t i = 0; i < lut_size; i ++) {
-		if (lut_typ == Random) {
-			lut[indices[i]] = rand() % (uint64_t)range;
-        } else if (lut_typ == Gamma) {
-			double input = (double)i/lut_size * 3 + 1; // from 1 to 4
-			double value = std::tgamma(input);
-            assert (value < 10);
-			lut[i] = ftoi(value, range);
-			abs_error[i] = abs(itof(lut[i], range) - value);
-			rel_error[i] = abs_error[i] / value;
-		} else if (lut_typ == Filled) {
-            lut[i] = output_bits == 64 ? UINT64_MAX : (1LL << output_bits) - 1;
-        } else if (lut_typ == Cauchy_dis) {
-			double input = (double)i/lut_size * 80 - 40; // from -40 to 40
-			double value = 1.0 / (M_PI * (1 + input * input));
-			lut[i] = ftoi(value, range, 0.35);
-			abs_error[i] = abs(itof(lut[i], range, 0.35) - value);
-			rel_error[i] = abs_error[i] / value;
+// Fixed-point approximation error of rows [begin, begin + count) of a LUT with lut_size rows, given in rows[0, count). 
+// Only Gamma and Cauchy_dis are approximations; other types report 0. 
+inline LUTErrorStats get_lut_error_rows(const LUTType lut_typ, uint64_t begin, uint64_t count, uint64_t lut_size, const uint64_t* rows, int output_bits = LUT_OUTPUT_SIZE) {
+	long double range = pow(2.0L, output_bits);
+	double max_abs_error = 0, max_rel_error = 0;
+	if (lut_typ != Gamma && lut_typ != Cauchy_dis)
+		return LUTErrorStats{0, 0};
+
+	#pragma omp parallel for reduction(max: max_abs_error, max_rel_error)
+	for (uint64_t k = 0; k < count; k++) {
+		uint64_t i = begin + k;
+		double value, abs_error;
+		if (lut_typ == Gamma) {
+			value = std::tgamma((double)i/lut_size * 3 + 1);
+			abs_error = std::abs(itof(rows[k], range) - value);
 		} else {
-			throw std::invalid_argument("LUT Type is not supported. ");
+			double input = (double)i/lut_size * 80 - 40;
+			value = 1.0 / (M_PI * (1 + input * input));
+			abs_error = std::abs(itof(rows[k], range, 0.35) - value);
 		}
+		max_abs_error = std::max(max_abs_error, abs_error);
+		max_rel_error = std::max(max_rel_error, abs_error / value);
 	}
-	std::cout << fmt::format(
-		"LUT built. \nMax Absolute error = {}\nMax Relative error = {}", 
-		*std::max_element(abs_error.begin(), abs_error.end()),
-		*std::max_element(rel_error.begin(), rel_error.end())
-	) << std::endl;
-	return lut;
+	return LUTErrorStats{max_abs_error, max_rel_error};
+}
+
+// Fixed-point approximation error of a whole generated LUT
+inline LUTErrorStats get_lut_error(const LUTType lut_typ, const std::vector<uint64_t>& lut, int output_bits = LUT_OUTPUT_SIZE) {
+	return get_lut_error_rows(lut_typ, 0, lut.size(), lut.size(), lut.data(), output_bits);
 }
 
 inline std::map<uint64_t, uint64_t> get_lut_map(const LUTType lut_typ, uint64_t lut_size, int seed, int input_bits = LUT_INPUT_SIZE, int output_bits = LUT_OUTPUT_SIZE) {
 	std::map<uint64_t, uint64_t> lut;
 	std::vector<uint64_t> lut_content = get_lut_vec(lut_typ, lut_size, seed, input_bits, output_bits);
 	for (uint64_t i = 0; i < lut_size; i ++) {
-		lut[i] = lut_content[i];
+		lut.emplace_hint(lut.end(), i, lut_content[i]);
+	}
+	return lut;
+}
+
+// Packed binary LUT file: a LUTFileHeader followed by lut_size rows of ceil(output_bits / 8) little-endian bytes. 
+struct LUTFileHeader {
+	char magic[4];
+	uint32_t input_bits;
+	uint32_t output_bits;
+	uint32_t reserved;
+	uint64_t lut_size;
+};
+
+inline uint64_t lut_row_bytes(int output_bits) {
+	return (output_bits + 7) / 8;
+}
+
+// Generate the LUT tile by tile and stream it to `filename`, never holding more than `tile_rows` rows in memory. 
+// Returns the approximation error of the LUT (see get_lut_error), accumulated over the tiles as they are written. 
+inline LUTErrorStats dump_lut_binary(const std::string& filename, const LUTType lut_typ, uint64_t lut_size, int seed, int input_bits = LUT_INPUT_SIZE, int output_bits = LUT_OUTPUT_SIZE, uint64_t tile_rows = (1ULL << 20)) {
+	if (lut_typ < 0 || lut_typ >= NumLUTTypes)
+		throw std::invalid_argument("LUT Type is not supported. ");
+	if (lut_size > (1ULL << input_bits))
+		throw std::invalid_argument("LUT size exceeds the input domain. ");
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out)
+		throw std::runtime_error(fmt::format("Cannot open {} for writing. ", filename));
+	LUTFileHeader header{{'F', 'L', 'U', 'T'}, (uint32_t)input_bits, (uint32_t)output_bits, 0, lut_size};
+	out.write((const char*)&header, sizeof(header));
+
+	uint64_t row_bytes = lut_row_bytes(output_bits);
+	std::vector<uint64_t> rows(std::min(tile_rows, lut_size));
+	std::vector<char> packed(rows.size() * row_bytes);
+	LUTErrorStats error{0, 0};
+	for (uint64_t begin = 0; begin < lut_size; begin += rows.size()) {
+		uint64_t count = std::min<uint64_t>(rows.size(), lut_size - begin);
+		fill_lut_rows(lut_typ, begin, count, lut_size, seed, output_bits, rows.data());
+		auto tile_error = get_lut_error_rows(lut_typ, begin, count, lut_size, rows.data(), output_bits);
+		error.max_abs_error = std::max(error.max_abs_error, tile_error.max_abs_error);
+		error.max_rel_error = std::max(error.max_rel_error, tile_error.max_rel_error);
+		#pragma omp parallel for
+		for (uint64_t k = 0; k < count; k++)
+			memcpy(packed.data() + k * row_bytes, &rows[k], row_bytes);
+		out.write(packed.data(), count * row_bytes);
 	}
+	if (!out)
+		throw std::runtime_error(fmt::format("Failed to write {}. ", filename));
+	return error;
+}
+
+// The header is validated against the file before anything is allocated. Rows are read into uint64_t, so output_bits <= 64.
+inline std::vector<uint64_t> load_lut_binary(const std::string& filename, LUTFileHeader* header_out = nullptr) {
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+	if (!in)
+		throw std::runtime_error(fmt::format("Cannot open {} for reading. ", filename));
+	uint64_t file_size = in.tellg();
+	in.seekg(0);
+	LUTFileHeader header;
+	in.read((char*)&header, sizeof(header));
+	if (!in || memcmp(header.magic, "FLUT", 4) != 0)
+		throw std::runtime_error(fmt::format("{} is not a packed LUT file. ", filename));
+	if (header.output_bits == 0 || header.output_bits > 64)
+		throw std::runtime_error(fmt::format("{}: outputs of {} bits are not supported. ", filename, header.output_bits));
+	if (header.input_bits == 0 || header.input_bits > 63 || header.lut_size > (1ULL << header.input_bits))
+		throw std::runtime_error(fmt::format("{}: {} rows do not fit {} input bits. ", filename, header.lut_size, header.input_bits));
+
+	uint64_t row_bytes = lut_row_bytes(header.output_bits);
+	if (header.lut_size > (file_size - sizeof(header)) / row_bytes)
+		throw std::runtime_error(fmt::format("{} is truncated. ", filename));
+	std::vector<uint64_t> lut(header.lut_size, 0);
+	std::vector<char> packed(header.lut_size * row_bytes);
+	in.read(packed.data(), packed.size());
+	if (!in)
+		throw std::runtime_error(fmt::format("{} is truncated. ", filename));
+	#pragma omp parallel for
+	for (uint64_t k = 0; k < header.lut_size; k++)
+		memcpy(&lut[k], packed.data() + k * row_bytes, row_bytes);
+	if (header_out)
+		*header_out = header;
 	return lut;
-}
\ No newline at end of file
+}
+
+#endif
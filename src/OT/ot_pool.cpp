@@ -0,0 +1,184 @@
+#include "ot_pool.h"
+
+#include <coproto/Common/macoro.h>
+#include <algorithm>
+#include <stdexcept>
+
+static SilentOTPool* installed_pool = nullptr;
+
+void set_silent_ot_pool(SilentOTPool* pool) {
+    installed_pool = pool;
+}
+
+SilentOTPool* silent_ot_pool() {
+    return installed_pool;
+}
+
+SilentOTPool::SilentOTPool(Role role, coproto::Socket chl, u64 numThreads, u64 batch_size, u64 watermark, MultType multType)
+    : pool_role(role), chl(chl), numThreads(numThreads), batch_size(batch_size), watermark(watermark), capacity(watermark + batch_size), multType(multType) {
+    if (batch_size == 0)
+        throw std::invalid_argument("[OT Pool] The batch size must be positive. ");
+    if (role == Role::Sender) {
+        sender_ring.resize(capacity);
+    } else {
+        receiver_ring.resize(capacity);
+        choice_ring.resize(capacity);
+    }
+    worker = std::thread([this]() { refill(); });
+}
+
+SilentOTPool::~SilentOTPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        cv.notify_all();
+    }
+    worker.join();
+    if (installed_pool == this)
+        installed_pool = nullptr;
+}
+
+u64 SilentOTPool::batches() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return num_batches;
+}
+
+u64 SilentOTPool::target_batches() const {
+    return (requested + watermark + batch_size - 1) / batch_size;
+}
+
+// Runs until every batch owed to the takes issued so far has been generated, so that the peer's pool, which sees the
+// same takes, never waits for a batch this pool will not run
+void SilentOTPool::refill() {
+    PRNG prng(sysRandomSeed());
+
+    macoro::thread_pool threadPool;
+    auto work = threadPool.make_work();
+    if (numThreads > 1)
+        threadPool.create_threads(numThreads);
+
+    SilentOtExtSender sender;
+    SilentOtExtReceiver recver;
+    std::vector<std::array<block, 2>> messages;
+    std::vector<block> received;
+    BitVector choices;
+    if (pool_role == Role::Sender) {
+        sender.mMultType = multType;
+        sender.configure(batch_size, 2, numThreads, SilentSecType::SemiHonest);
+        messages.resize(batch_size);
+    } else {
+        recver.mMultType = multType;
+        recver.configure(batch_size, 2, numThreads, SilentSecType::SemiHonest);
+        received.resize(batch_size);
+        choices.resize(batch_size);
+    }
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return stopping || num_batches < target_batches(); });
+            if (num_batches >= target_batches())
+                break;
+        }
+
+        // The first batch generates the base OTs and the OT extension on top of them; later batches only extend
+        if (pool_role == Role::Sender) {
+            cp::sync_wait(sender.genSilentBaseOts(prng, chl, true));
+            auto protocol = sender.silentSend(messages, prng, chl);
+            if (numThreads <= 1)
+                cp::sync_wait(protocol);
+            else
+                cp::sync_wait(std::move(protocol) | macoro::start_on(threadPool));
+        } else {
+            cp::sync_wait(recver.genSilentBaseOts(prng, chl, true));
+            auto protocol = recver.silentReceive(choices, received, prng, chl);
+            if (numThreads <= 1)
+                cp::sync_wait(protocol);
+            else
+                cp::sync_wait(std::move(protocol) | macoro::start_on(threadPool));
+        }
+        cp::sync_wait(chl.flush());
+
+        u64 begin;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return stopping || capacity - (generated - pulled) >= batch_size; });
+            if (stopping) {
+                // Nobody takes from the pool anymore; the batch only kept it in step with the peer
+                num_batches++;
+                continue;
+            }
+            begin = generated;
+        }
+        // Slots [generated, generated + batch_size) are free, so the takers do not read them
+        for (u64 i = 0; i < batch_size; i++) {
+            u64 slot = (begin + i) % capacity;
+            if (pool_role == Role::Sender) {
+                sender_ring[slot] = messages[i];
+            } else {
+                receiver_ring[slot] = received[i];
+                choice_ring[slot] = choices[i];
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generated += batch_size;
+            num_batches++;
+            cv.notify_all();
+        }
+    }
+}
+
+std::pair<u64, u64> SilentOTPool::wait_available(u64 numOTs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return generated > pulled; });
+    u64 begin = pulled % capacity;
+    u64 count = std::min({numOTs, generated - pulled, capacity - begin});
+    return {begin, count};
+}
+
+void SilentOTPool::release(u64 count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pulled += count;
+    cv.notify_all();
+}
+
+SilentOTResultServer SilentOTPool::take_sender(u64 numOTs) {
+    if (pool_role != Role::Sender)
+        throw std::logic_error("[OT Pool] take_sender on a receiver pool. ");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requested += numOTs;
+        cv.notify_all();
+    }
+    std::vector<std::array<block, 2>> messages(numOTs);
+    for (u64 done = 0; done < numOTs; ) {
+        auto [begin, count] = wait_available(numOTs - done);
+        std::copy(sender_ring.begin() + begin, sender_ring.begin() + begin + count, messages.begin() + done);
+        release(count);
+        done += count;
+    }
+    return SilentOTResultServer{messages};
+}
+
+SilentOTResultClient SilentOTPool::take_receiver(u64 numOTs) {
+    if (pool_role != Role::Receiver)
+        throw std::logic_error("[OT Pool] take_receiver on a sender pool. ");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requested += numOTs;
+        cv.notify_all();
+    }
+    std::vector<block> messages(numOTs);
+    BitVector choices(numOTs);
+    for (u64 done = 0; done < numOTs; ) {
+        auto [begin, count] = wait_available(numOTs - done);
+        for (u64 i = 0; i < count; i++) {
+            messages[done + i] = receiver_ring[begin + i];
+            choices[done + i] = choice_ring[begin + i];
+        }
+        release(count);
+        done += count;
+    }
+    return SilentOTResultClient{messages, choices};
+}
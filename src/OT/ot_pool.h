@@ -0,0 +1,62 @@
+#ifndef FABLE_OT_POOL_H__
+#define FABLE_OT_POOL_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "OT/silent_ot.h"
+
+// A pool of random 1-out-of-2 OT correlations, produced in the background by one persistent silent OT sender
+// (or receiver) over its own channel, usually chl.fork(). The base OTs and the thread pool are set up once per pool,
+// and every later batch only extends them.
+//
+// Both parties must create their pools together (one as Sender, one as Receiver) and take the same numbers of OTs
+// in the same order, one take at a time. Refills are decided from the total taken so far, so the two pools run the same batches:
+// a batch of batch_size OTs is generated whenever fewer than watermark OTs are left for the takes issued so far.
+// The ring buffer holds at most watermark + batch_size correlations.
+class SilentOTPool {
+public:
+    SilentOTPool(Role role, coproto::Socket chl, u64 numThreads = 1, u64 batch_size = 1 << 20, u64 watermark = 1 << 18, MultType multType = MultType::ExConv7x24);
+    ~SilentOTPool();
+
+    Role role() const { return pool_role; }
+
+    // Blocks until numOTs correlations are available. take_sender on the Sender pool only, take_receiver on the Receiver.
+    SilentOTResultServer take_sender(u64 numOTs);
+    SilentOTResultClient take_receiver(u64 numOTs);
+
+    // Batches generated so far
+    u64 batches() const;
+
+private:
+    u64 target_batches() const;
+    void refill();
+    // Waits for the next min(available, numOTs) correlations; returns their first ring index and how many they are
+    std::pair<u64, u64> wait_available(u64 numOTs);
+    void release(u64 count);
+
+    Role pool_role;
+    coproto::Socket chl;
+    u64 numThreads, batch_size, watermark, capacity;
+    MultType multType;
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    u64 requested = 0, pulled = 0, generated = 0, num_batches = 0;
+    bool stopping = false;
+
+    std::vector<std::array<block, 2>> sender_ring;
+    std::vector<block> receiver_ring;
+    std::vector<uint8_t> choice_ring;
+
+    std::thread worker;
+};
+
+// While a pool is installed, SilentOT_1_out_of_2_server / _client (and thus SPLUT and the 1-out-of-N OTs) take
+// their correlations from it when its role matches, instead of running a fresh silent OT over their channel.
+void set_silent_ot_pool(SilentOTPool* pool);
+SilentOTPool* silent_ot_pool();
+
+#endif
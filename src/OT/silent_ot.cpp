@@ -1,4 +1,5 @@
 #include "silent_ot.h"
+#include "ot_pool.h"
 
 #include <coproto/Common/macoro.h>
 #include <cryptoTools/Common/block.h>
@@ -8,6 +9,8 @@
 SilentOTResultServer SilentOT_1_out_of_2_server(u64 numOTs, coproto::AsioSocket& chl, u64 numThreads, SilentBaseType type, MultType multType)
 {
     assert (numOTs > 0);
+    if (auto pool = silent_ot_pool(); pool && pool->role() == Role::Sender)
+        return pool->take_sender(numOTs);
     // get up the networking
 
     PRNG prng(sysRandomSeed());
@@ -51,6 +54,8 @@ SilentOTResultServer SilentOT_1_out_of_2_server(u64 numOTs, coproto::AsioSocket&
 SilentOTResultClient SilentOT_1_out_of_2_client(u64 numOTs, coproto::AsioSocket& chl, u64 numThreads, SilentBaseType type, MultType multType)
 {
     assert (numOTs > 0);
+    if (auto pool = silent_ot_pool(); pool && pool->role() == Role::Receiver)
+        return pool->take_receiver(numOTs);
     // get up the networking
 
     PRNG prng(sysRandomSeed());
@@ -100,10 +105,8 @@ SilentOTResultClient SilentOT_1_out_of_2_client(u64 numOTs, coproto::AsioSocket&
 
 SilentOTResultServer_N SilentOT_1_out_of_N_server(u64 numOTs, u64 numThreads, coproto::AsioSocket& chl, uint64_t power, SilentBaseType type, MultType multType) {
 
-    assert (power <= POWER_MAX);
-
     start_record(chl, "OT");
-    auto messages = SilentOT_1_out_of_2_server(numOTs * power, chl, numThreads, type, multType);
+    auto compressed = SilentOT_1_out_of_N_server_Compressed(numOTs, numThreads, chl, power, type, multType);
     end_record(chl, "OT");
 
     u64 size = 1ULL << power;
@@ -111,25 +114,9 @@ SilentOTResultServer_N SilentOT_1_out_of_N_server(u64 numOTs, u64 numThreads, co
     result.messages.resize(numOTs, std::vector<block>(size, ZeroBlock));
 
     start_record(chl, "AES");
-    std::vector<std::array<AES, 2>> AESs(numOTs * power); 
-
-    # pragma omp parallel for if (numThreads > 1) collapse(2)
-    for (int k = 0; k < numOTs; k++) {
-        for (int j = 0; j < power; j++) {
-            AESs[k*power+j][0].setKey(messages.messages[k*power+j][0]);
-            AESs[k*power+j][1].setKey(messages.messages[k*power+j][1]);
-        }
-    }
-
-    # pragma omp parallel for if (numThreads > 1) collapse(2)
+    # pragma omp parallel for if (numThreads > 1) num_threads(numThreads)
     for (int k = 0; k < numOTs; k++) {
-        for (int i = 0; i < size; i++) {
-            std::bitset<POWER_MAX> bits(i);
-            result.messages[k][i] = ZeroBlock;
-            for (int j = 0; j < power; j++) {
-               result.messages[k][i] = result.messages[k][i] ^ AESs[k*power+j][bits[j]].ecbEncBlock(block(i));
-            }
-        }
+        compressed.get_messages(k, 0, size, result.messages[k].data());
     }
     end_record(chl, "AES");
 
@@ -142,10 +129,12 @@ SilentOTResultServer_N_Compressed SilentOT_1_out_of_N_server_Compressed(u64 numO
 
     auto messages = SilentOT_1_out_of_2_server(numOTs * power, chl, numThreads, type, multType);
 
-    u64 size = 1ULL << power;
+    // Only the keys are expanded here: the messages are derived on demand by get_messages, i.e., inside the caller's online phase
+    start_record(chl, "OT Key Expansion");
     SilentOTResultServer_N_Compressed result;
     result.AESs.resize(numOTs * power);
 
+    # pragma omp parallel for if (numThreads > 1) collapse(2) num_threads(numThreads)
     for (int k = 0; k < numOTs; k++) {
         for (int j = 0; j < power; j++) {
             result.AESs[k*power+j][0].setKey(messages.messages[k*power+j][0]);
@@ -153,34 +142,70 @@ SilentOTResultServer_N_Compressed SilentOT_1_out_of_N_server_Compressed(u64 numO
         }
     }
     result.power = power;
+    end_record(chl, "OT Key Expansion");
 
     return result;
 }
 
+void SilentOTResultServer_N_Compressed::get_messages(int k, u64 begin, u64 count, block* messages) const {
+    block in[MASK_TILE], out[MASK_TILE];
+    for (u64 tile_begin = begin; tile_begin < begin + count; tile_begin += MASK_TILE) {
+        u64 tile = std::min<u64>(MASK_TILE, begin + count - tile_begin);
+        block* acc = messages + (tile_begin - begin);
+        std::fill(acc, acc + tile, ZeroBlock);
+        for (int j = 0; j < power; j++) {
+            for (int bit = 0; bit < 2; bit++) {
+                u64 n = 0;
+                for (u64 i = 0; i < tile; i++)
+                    if (((tile_begin + i) >> j & 1) == bit)
+                        in[n++] = block(tile_begin + i);
+                AESs[k*power+j][bit].ecbEncBlocks(in, n, out);
+                n = 0;
+                for (u64 i = 0; i < tile; i++)
+                    if (((tile_begin + i) >> j & 1) == bit)
+                        acc[i] = acc[i] ^ out[n++];
+            }
+        }
+    }
+}
+
+// Keys whose encryptions of the same block are pipelined by one MultiKeyAES
+const int DERIVE_KEYS = 8;
+
 SilentOTResultClient_N SilentOT_1_out_of_N_client(u64 numOTs, u64 numThreads, coproto::AsioSocket& chl, uint64_t power, SilentBaseType type, MultType multType) {
 
     assert (power <= POWER_MAX);
 
     auto messages = SilentOT_1_out_of_2_client(numOTs * power, chl, numThreads, type, multType);
 
-    std::vector<std::bitset<POWER_MAX>> selection_bits(numOTs);
-    for (int k = 0; k < numOTs; k++)
-        for (int j = 0; j < power; j++)
-            selection_bits[k][j] = messages.choices[k*power+j];
+    start_record(chl, "OT Derivation");
+    SilentOTResultClient_N result{std::vector<block>(numOTs, ZeroBlock), std::vector<u64>(numOTs, 0)};
 
-    u64 size = 1ULL << power;
-    SilentOTResultClient_N result{std::vector<block>(numOTs, ZeroBlock)};
-    
+    // message[k] = XOR_j AES_{key (k, j)}(choice[k]): the power keys of OT k encrypt the same block, so they are
+    // expanded and run DERIVE_KEYS at a time through the AES-NI pipeline
+    # pragma omp parallel for if (numThreads > 1) num_threads(numThreads)
     for (int k = 0; k < numOTs; k++) {
-        result.choices.push_back(selection_bits[k].to_ullong());
-    }
-
-    for (int k = 0; k < numOTs; k++) {
-        for (int j = 0; j < power; j++) {
-            AES aes(messages.messages[k*power+j]);
-            result.message[k] = result.message[k] ^ aes.ecbEncBlock(block(result.choices[k]));
+        u64 choice = 0;
+        for (int j = 0; j < power; j++)
+            choice |= (u64)messages.choices[k*power+j] << j;
+        result.choices[k] = choice;
+
+        block plaintexts[DERIVE_KEYS], ciphertexts[DERIVE_KEYS], keys[DERIVE_KEYS];
+        std::fill(plaintexts, plaintexts + DERIVE_KEYS, block(choice));
+        MultiKeyAES<DERIVE_KEYS> aes;
+        block acc = ZeroBlock;
+        for (int j = 0; j < power; j += DERIVE_KEYS) {
+            int n = std::min<int>(DERIVE_KEYS, power - j);
+            std::fill(keys, keys + DERIVE_KEYS, ZeroBlock);
+            std::copy(messages.messages.begin() + k*power + j, messages.messages.begin() + k*power + j + n, keys);
+            aes.setKeys(keys);
+            aes.ecbEncNBlocks(plaintexts, ciphertexts);
+            for (int i = 0; i < n; i++)
+                acc = acc ^ ciphertexts[i];
         }
+        result.message[k] = acc;
     }
+    end_record(chl, "OT Derivation");
 
     return result;
-}
\ No newline at end of file
+}
@@ -18,6 +18,8 @@ enum class Role
 };
 
 const u64 POWER_MAX = 32;
+// Positions of a 1-out-of-N OT generated together by SilentOTResultServer_N_Compressed::get_messages
+const u64 MASK_TILE = 256;
 
 inline uint32_t blocktoint(block b) {
   return b.get<uint32_t>()[0];
@@ -36,14 +38,9 @@ struct SilentOTResultServer_N_Compressed {
   std::vector<std::array<AES, 2>> AESs;
   uint64_t power;
 
-  inline uint32_t get_mask(int k, int i) {
-    block b = ZeroBlock;
-    std::bitset<POWER_MAX> bits(i);
-    for (int j = 0; j < power; j++) {
-        b = b ^ AESs[k*power+j][bits[j]].ecbEncBlock(block(i));
-    }
-    return b.get<uint32_t>()[0];
-  }
+  // Messages of positions [begin, begin + count) of OT k, generated on demand. The positions are processed in
+  // tiles, and within a tile all positions encrypted under the same key go through one pipelined ecbEncBlocks call.
+  void get_messages(int k, u64 begin, u64 count, block* messages) const;
 };
 
 struct SilentOTResultClient_N {
@@ -57,6 +54,8 @@ SilentOTResultClient SilentOT_1_out_of_2_client(u64 numOTs, coproto::AsioSocket&
 
 
 // 1 out of N = 2^power silent OT
+// The _Compressed server keeps only the 2 * power AES keys of every OT; callers that consume the messages row by row
+// should use it with get_messages, since SilentOT_1_out_of_N_server materializes all numOTs * 2^power messages.
 SilentOTResultServer_N SilentOT_1_out_of_N_server(u64 numOTs, u64 numThreads, coproto::AsioSocket& chl, uint64_t power, SilentBaseType type = SilentBaseType::BaseExtend, MultType multType = MultType::ExConv7x24);
 SilentOTResultServer_N_Compressed SilentOT_1_out_of_N_server_Compressed(u64 numOTs, u64 numThreads, coproto::AsioSocket& chl, uint64_t power, SilentBaseType type = SilentBaseType::BaseExtend, MultType multType = MultType::ExConv7x24);
 SilentOTResultClient_N SilentOT_1_out_of_N_client(u64 numOTs, u64 numThreads, coproto::AsioSocket& chl, uint64_t power, SilentBaseType type = SilentBaseType::BaseExtend, MultType multType = MultType::ExConv7x24);
@@ -1,8 +1,10 @@
 #include <cryptoTools/Common/BitVector.h>
 #include <cryptoTools/Common/Defines.h>
 #include <cstdint>
-#include <bitset>
+#include <cstring>
+#include <thread>
 #include <fmt/format.h>
+#include <stdexcept>
 #include <libOTe/TwoChooseOne/ConfigureCode.h>
 #include <libOTe/TwoChooseOne/TcoOtDefines.h>
 #include "OT/silent_ot.h"
@@ -12,101 +14,130 @@
 
 uint64_t total_system_memory = sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
 
-inline uint32_t highestPowerOfTwoIn(uint32_t x) {
-  return 0x80000000 >> __builtin_clz(x);
+// The tile of OT messages that a thread is currently packing from, generated with SilentOTResultServer_N_Compressed::get_messages.
+// Position i of query b is masked with message i ^ u[b]; as i runs through an aligned tile, so does i ^ u[b], so each
+// thread generates every tile of its queries once and never holds more than MASK_TILE messages.
+struct MaskTile {
+  int64_t query = -1;
+  uint64_t begin = 0;
+  block messages[MASK_TILE];
+};
+
+// The low l_out bits of a Word
+template<typename Word>
+inline Word word_mask(uint64_t l_out) {
+  return l_out >= 8 * sizeof(Word) ? ~Word(0) : (Word(1) << l_out) - 1;
 }
 
-std::vector<uint32_t> SPLUT(const std::vector<uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads) {
-
-  PRNG prng(sysRandomSeed());
-
-  auto lut_size = 1ULL << l_in;
-  uint32_t in_mask = (1ULL << l_in) - 1;
-  uint32_t out_mask = (1ULL << l_out) - 1;
-  int batch_size = x.size();
-
-  std::vector<uint32_t> z(batch_size);
-  std::vector<uint32_t> u(batch_size);
-  uint64_t chunk_size = std::min<uint64_t>(batch_size, highestPowerOfTwoIn(std::min<uint64_t>(std::numeric_limits<u32>::max(), total_system_memory * 4) / (lut_size * l_out))); // allow v_serialize to use at most half of the memory
-  BitVector v_serialized(chunk_size * lut_size * l_out);
-  
-  for (int b = 0; b < batch_size; b++) {
-    z[b] = prng.get<uint32_t>() & out_mask;
-  }
+// Reads n <= 64 bits of v_serialized starting at bit, with at most two unaligned word loads
+static uint64_t read_bits(const BitVector& v_serialized, uint64_t bit, uint64_t n) {
+  uint64_t offset = bit / 8, shift = bit % 8;
+  uint64_t bytes = v_serialized.sizeBytes();
+  uint64_t lo = 0, hi = 0;
+  memcpy(&lo, v_serialized.data() + offset, std::min<uint64_t>(sizeof(uint64_t), bytes - offset));
+  if (shift + n > 64 && offset + sizeof(uint64_t) < bytes)
+    memcpy(&hi, v_serialized.data() + offset + sizeof(uint64_t), std::min<uint64_t>(sizeof(uint64_t), bytes - offset - sizeof(uint64_t)));
+  uint64_t bits = (lo >> shift) | (shift ? hi << (64 - shift) : 0);
+  return n >= 64 ? bits : bits & ((1ULL << n) - 1);
+}
 
-  start_record(chl, "SPLUT+");
-  if (party == sci::ALICE) {
-    start_record(chl, "Setup Phase");
-    auto result = SilentOT_1_out_of_N_server_Compressed(batch_size, numThreads, chl, l_in);
-    end_record(chl, "Setup Phase");
-    
-    start_record(chl, "Online Phase");
-    cp::sync_wait(chl.recv(u));
-    
-    for (int chunk_idx = 0; chunk_idx < batch_size / chunk_size; chunk_idx++) {
-      # pragma omp parallel for collapse(2) num_threads(numThreads)
-      for (int c = 0; c < chunk_size; c++) {
-        for (int i = 0; i < lut_size; i++) {
-          int b = chunk_idx * chunk_size + c;
-          auto m = result.get_mask(b, i ^ u[b]);
-          uint32_t v = (T[i ^ x[b]] ^ m ^ z[b]) & out_mask;
-          std::bitset<POWER_MAX> blk(v);
-          for (int j = 0; j < l_out; j++) {
-            v_serialized[c * (lut_size * l_out) + i * l_out + j] = blk[j];
-          }
+// v_serialized holds the l_out-bit entries of a chunk back to back, entry e = c * 2^l_in + i at bit e * l_out.
+// Every 64 consecutive entries fill exactly l_out 64-bit words, so each thread packs whole groups of 64 entries
+// with shifts into a word buffer and stores full words; no two threads touch the same byte.
+// Entries wider than 64 bits are pushed one 64-bit limb at a time.
+// Groups are split statically, so that each thread walks through consecutive entries with its own State.
+template<typename Word, typename State, typename Entry>
+static void pack_entries(BitVector& v_serialized, uint64_t num_entries, uint64_t l_in, uint64_t l_out, uint64_t numThreads, Entry entry) {
+  uint8_t* out = v_serialized.data();
+  uint64_t out_bytes = v_serialized.sizeBytes();
+  uint64_t num_groups = (num_entries + 63) / 64;
+  uint64_t in_mask = (1ULL << l_in) - 1;
+  # pragma omp parallel num_threads(numThreads)
+  {
+    State state;
+    std::vector<uint64_t> words(l_out);
+    # pragma omp for schedule(static)
+    for (uint64_t g = 0; g < num_groups; g++) {
+      uint64_t acc = 0, fill = 0, num_words = 0;
+      // Appends the low n <= 64 bits of bits, which must be zero above them
+      auto push = [&](uint64_t bits, uint64_t n) {
+        acc |= bits << fill;
+        if (fill + n >= 64) {
+          words[num_words++] = acc;
+          acc = fill ? bits >> (64 - fill) : 0;
+          fill = fill + n - 64;
+        } else {
+          fill += n;
         }
+      };
+      uint64_t end = std::min<uint64_t>(num_entries, (g + 1) * 64);
+      for (uint64_t e = g * 64; e < end; e++) {
+        Word v = entry(state, e >> l_in, e & in_mask);
+        for (uint64_t limb = 0; limb * 64 < l_out; limb++)
+          push((uint64_t)(v >> (limb * 32) >> (limb * 32)), std::min<uint64_t>(64, l_out - limb * 64));
       }
-      cp::sync_wait(chl.send(v_serialized));
+      if (fill)
+        words[num_words++] = acc;
+      uint64_t offset = g * l_out * sizeof(uint64_t);
+      memcpy(out + offset, words.data(), std::min<uint64_t>(num_words * sizeof(uint64_t), out_bytes - offset));
     }
-    end_record(chl, "Online Phase");
+  }
+}
 
-  } else { // party == BOB
-    start_record(chl, "Setup Phase");
-    auto [ms, s] = SilentOT_1_out_of_N_client(batch_size, numThreads, chl, l_in);
-    end_record(chl, "Setup Phase");
+// Reads the l_out-bit entry e of v_serialized
+template<typename Word>
+static Word unpack_entry(const BitVector& v_serialized, uint64_t e, uint64_t l_out) {
+  Word v = 0;
+  for (uint64_t limb = 0; limb * 64 < l_out; limb++)
+    v |= (Word)read_bits(v_serialized, e * l_out + limb * 64, std::min<uint64_t>(64, l_out - limb * 64)) << (limb * 32) << (limb * 32);
+  return v;
+}
 
-    start_record(chl, "Online Phase");
-    for (int b = 0; b < batch_size; b++) {
-      u[b] = x[b] ^ s[b];
-    }
-    cp::sync_wait(chl.send(u));
-    
-    for (int chunk_idx = 0; chunk_idx < batch_size / chunk_size; chunk_idx++) {
-      cp::sync_wait(chl.recv(v_serialized));
-      for (int c = 0; c < chunk_size; c++) {
-        int b = chunk_idx * chunk_size + c;
-        std::bitset<POWER_MAX> blk;
-        for (int j = 0; j < l_out; j++) {
-          blk[j] = v_serialized[c * (lut_size * l_out) + x[b] * l_out + j];
-        }
-        uint32_t v = blk.to_ulong();
-        z[b] = (v ^ ms[b].get<uint32_t>()[0]) & out_mask;
-      }
-    }
-    end_record(chl, "Online Phase");
-  }
-  end_record(chl, "SPLUT+");
-  
-  cp::sync_wait(chl.flush());
-  return z;
+// The low bytes of an OT message, used as the mask
+template<typename Word>
+inline Word block_to_word(const block& b) {
+  Word w;
+  memcpy(&w, &b, sizeof(Word));
+  return w;
+}
+
+// Chunk k of the online phase covers queries [k * chunk_size, min(batch_size, (k + 1) * chunk_size))
+inline uint64_t chunk_rows(uint64_t batch_size, uint64_t chunk_size, uint64_t chunk_idx) {
+  return std::min<uint64_t>(batch_size, (chunk_idx + 1) * chunk_size) - chunk_idx * chunk_size;
 }
 
-std::vector<uint32_t> SPLUT(std::map<uint64_t, uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads) {
+// The SPLUT+ protocol for any table with operator[] over all 2^l_in positions; only ALICE reads it.
+// Outputs are l_out <= 8 * sizeof(Word) bits, masked with the low bytes of the 128-bit OT messages.
+// The online phase is streamed in chunks of queries through two buffers: ALICE packs chunk k+1 while chunk k is
+// being sent, and BOB receives chunk k+1 while he decodes chunk k. ALICE picks the chunk size, so that both
+// buffers fit in max_memory bytes, and tells BOB.
+template<typename Word, typename Table>
+static std::vector<Word> SPLUT_engine(const Table &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads, uint64_t max_memory) {
 
   PRNG prng(sysRandomSeed());
 
   auto lut_size = 1ULL << l_in;
-  uint32_t in_mask = (1ULL << l_in) - 1;
-  uint32_t out_mask = (1ULL << l_out) - 1;
+  Word out_mask = word_mask<Word>(l_out);
   int batch_size = x.size();
 
-  std::vector<uint32_t> z(batch_size);
+  if (l_in > POWER_MAX || l_out == 0 || l_out > 8 * sizeof(Word))
+    throw std::invalid_argument(fmt::format("[SPLUT] Unsupported bit lengths: l_in = {}, l_out = {}. ", l_in, l_out));
+
+  std::vector<Word> z(batch_size);
   std::vector<uint32_t> u(batch_size);
-  uint64_t chunk_size = std::min<uint64_t>(batch_size, highestPowerOfTwoIn(std::min<uint64_t>(std::numeric_limits<u32>::max(), total_system_memory * 4) / (lut_size * l_out))); // allow v_serialize to use at most half of the memory
-  BitVector v_serialized(chunk_size * lut_size * l_out);
+  uint64_t row_bits = lut_size * l_out;
+  if (max_memory == 0)
+    max_memory = total_system_memory / 2;
+  // A single message must stay below 4 GiB
+  uint64_t buffer_bits = std::min<uint64_t>(max_memory / 2, std::numeric_limits<u32>::max()) * 8;
+  // Each buffer holds whole rows, so the bound cannot be met if one row is larger than a buffer
+  if (party == sci::ALICE && row_bits > buffer_bits)
+    throw std::invalid_argument(fmt::format("[SPLUT] A row of 2^{} x {} bits does not fit a buffer of {} bytes (max_memory = {}). ", l_in, l_out, buffer_bits / 8, max_memory));
+  uint64_t chunk_size = std::max<uint64_t>(1, std::min<uint64_t>(batch_size, buffer_bits / row_bits));
+  BitVector v_serialized[2];
   
   for (int b = 0; b < batch_size; b++) {
-    z[b] = prng.get<uint32_t>() & out_mask;
+    z[b] = prng.get<Word>() & out_mask;
   }
 
   start_record(chl, "SPLUT+");
@@ -117,22 +148,33 @@ std::vector<uint32_t> SPLUT(std::map<uint64_t, uint64_t> &T, std::vector<uint32_
     
     start_record(chl, "Online Phase");
     cp::sync_wait(chl.recv(u));
+    cp::sync_wait(chl.send(chunk_size));
     
-    for (int chunk_idx = 0; chunk_idx < batch_size / chunk_size; chunk_idx++) {
-      # pragma omp parallel for collapse(2) num_threads(numThreads)
-      for (int c = 0; c < chunk_size; c++) {
-        for (int i = 0; i < lut_size; i++) {
-          int b = chunk_idx * chunk_size + c;
-          auto m = result.get_mask(b, i ^ u[b]);
-          uint32_t v = (T[i ^ x[b]] ^ m ^ z[b]) & out_mask;
-          std::bitset<POWER_MAX> blk(v);
-          for (int j = 0; j < l_out; j++) {
-            v_serialized[c * (lut_size * l_out) + i * l_out + j] = blk[j];
-          }
+    uint64_t num_chunks = (batch_size + chunk_size - 1) / chunk_size;
+    uint64_t tile = std::min<uint64_t>(MASK_TILE, lut_size);
+    std::thread sender;
+    for (uint64_t chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++) {
+      // The buffer was last sent two chunks ago, and that send was joined before the previous one started
+      auto& buffer = v_serialized[chunk_idx % 2];
+      uint64_t rows = chunk_rows(batch_size, chunk_size, chunk_idx);
+      buffer.resize(rows * row_bits);
+      pack_entries<Word, MaskTile>(buffer, rows * lut_size, l_in, l_out, numThreads, [&](MaskTile& cache, uint64_t c, uint64_t i) {
+        int b = chunk_idx * chunk_size + c;
+        uint64_t position = i ^ u[b], begin = position & ~(tile - 1);
+        if (cache.query != b || cache.begin != begin) {
+          result.get_messages(b, begin, tile, cache.messages);
+          cache.query = b;
+          cache.begin = begin;
         }
-      }
-      cp::sync_wait(chl.send(v_serialized));
+        Word mask = block_to_word<Word>(cache.messages[position - begin]);
+        return (Word)(((Word)T[i ^ x[b]] ^ mask ^ z[b]) & out_mask);
+      });
+      if (sender.joinable())
+        sender.join();
+      sender = std::thread([&chl, &buffer]() { cp::sync_wait(chl.send(buffer)); });
     }
+    if (sender.joinable())
+      sender.join();
     end_record(chl, "Online Phase");
 
   } else { // party == BOB
@@ -145,17 +187,26 @@ std::vector<uint32_t> SPLUT(std::map<uint64_t, uint64_t> &T, std::vector<uint32_
       u[b] = x[b] ^ s[b];
     }
     cp::sync_wait(chl.send(u));
+    cp::sync_wait(chl.recv(chunk_size));
     
-    for (int chunk_idx = 0; chunk_idx < batch_size / chunk_size; chunk_idx++) {
-      cp::sync_wait(chl.recv(v_serialized));
-      for (int c = 0; c < chunk_size; c++) {
+    uint64_t num_chunks = (batch_size + chunk_size - 1) / chunk_size;
+    std::thread receiver;
+    auto receive = [&](uint64_t chunk_idx) {
+      auto& buffer = v_serialized[chunk_idx % 2];
+      buffer.resize(chunk_rows(batch_size, chunk_size, chunk_idx) * row_bits);
+      receiver = std::thread([&chl, &buffer]() { cp::sync_wait(chl.recv(buffer)); });
+    };
+    if (num_chunks > 0)
+      receive(0);
+    for (uint64_t chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++) {
+      receiver.join();
+      if (chunk_idx + 1 < num_chunks)
+        receive(chunk_idx + 1);
+      auto& buffer = v_serialized[chunk_idx % 2];
+      for (uint64_t c = 0; c < chunk_rows(batch_size, chunk_size, chunk_idx); c++) {
         int b = chunk_idx * chunk_size + c;
-        std::bitset<POWER_MAX> blk;
-        for (int j = 0; j < l_out; j++) {
-          blk[j] = v_serialized[c * (lut_size * l_out) + x[b] * l_out + j];
-        }
-        uint32_t v = blk.to_ulong();
-        z[b] = (v ^ ms[b].get<uint32_t>()[0]) & out_mask;
+        Word v = unpack_entry<Word>(buffer, c * lut_size + x[b], l_out);
+        z[b] = (v ^ block_to_word<Word>(ms[b])) & out_mask;
       }
     }
     end_record(chl, "Online Phase");
@@ -164,4 +215,32 @@ std::vector<uint32_t> SPLUT(std::map<uint64_t, uint64_t> &T, std::vector<uint32_
   
   cp::sync_wait(chl.flush());
   return z;
-}
\ No newline at end of file
+}
+
+std::vector<uint32_t> SPLUT(const std::vector<uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads, uint64_t max_memory) {
+  if (party == sci::ALICE && T.size() < (1ULL << l_in))
+    throw std::invalid_argument(fmt::format("[SPLUT] The LUT has {} entries, but 2^{} are needed. ", T.size(), l_in));
+  return SPLUT_engine<uint32_t>(T, x, l_out, l_in, party, chl, numThreads, max_memory);
+}
+
+// Densifies the table once, so that the online loop reads a flat array instead of searching (and inserting into) the map
+std::vector<uint32_t> SPLUT(const std::map<uint64_t, uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads, uint64_t default_value, uint64_t max_memory) {
+  std::vector<uint64_t> dense;
+  if (party == sci::ALICE) {
+    dense.assign(1ULL << l_in, default_value);
+    for (auto it = T.begin(), end = T.lower_bound(dense.size()); it != end; it++)
+      dense[it->first] = it->second;
+  }
+  return SPLUT_engine<uint32_t>(dense, x, l_out, l_in, party, chl, numThreads, max_memory);
+}
+
+template<typename Word>
+std::vector<Word> SPLUT_wide(const std::vector<Word> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads, uint64_t max_memory) {
+  if (party == sci::ALICE && T.size() < (1ULL << l_in))
+    throw std::invalid_argument(fmt::format("[SPLUT] The LUT has {} entries, but 2^{} are needed. ", T.size(), l_in));
+  return SPLUT_engine<Word>(T, x, l_out, l_in, party, chl, numThreads, max_memory);
+}
+
+template std::vector<uint32_t> SPLUT_wide(const std::vector<uint32_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads, uint64_t max_memory);
+template std::vector<uint64_t> SPLUT_wide(const std::vector<uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads, uint64_t max_memory);
+template std::vector<unsigned __int128> SPLUT_wide(const std::vector<unsigned __int128> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads, uint64_t max_memory);
@@ -3,5 +3,11 @@
 #include <cstdint>
 #include "coproto/Socket/AsioSocket.h"
 
-std::vector<uint32_t> SPLUT(const std::vector<uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads = 1);
-std::vector<uint32_t> SPLUT(std::map<uint64_t, uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads = 1);
\ No newline at end of file
+// max_memory bounds the bytes buffered by the online phase; 0 = half of the system memory. Only ALICE's value is used, and it
+// must hold two rows of 2^l_in * l_out bits, otherwise ALICE throws std::invalid_argument.
+std::vector<uint32_t> SPLUT(const std::vector<uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads = 1, uint64_t max_memory = 0);
+// Positions of [0, 2^l_in) missing from T hold default_value
+std::vector<uint32_t> SPLUT(const std::map<uint64_t, uint64_t> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads = 1, uint64_t default_value = 0, uint64_t max_memory = 0);
+// Outputs of up to 8 * sizeof(Word) bits, e.g. to run on the same wide LUTs as FABLE. Word is uint32_t, uint64_t or unsigned __int128.
+template<typename Word>
+std::vector<Word> SPLUT_wide(const std::vector<Word> &T, std::vector<uint32_t> x, uint64_t l_out, uint64_t l_in, int party, coproto::AsioSocket& chl, uint64_t numThreads = 1, uint64_t max_memory = 0);
@@ -1,11 +1,16 @@
 #include "GC/emp-sh2pc.h"
+#include "GC/conversion.h"
+#include "GC/share.h"
+#include "GC/gate_counter.h"
 #include "GC/lookup.h"
 #include "utils/io_utils.h"
+#include "utils/netem.h"
 
 using namespace sci;
 
 
-int party, port = 8000, parallel = 1, num_threads = 32, seed = 12345;
+int party, port = 8000, parallel = 1, num_threads = 32, seed = 12345, bandwidth = 0, rtt = 0, jitter = 0, arith = 1;
+std::string json_file, csv_file;
 NetIO *io_gc;
 
 const size_t input_bits = 20; 
@@ -58,11 +63,20 @@ void bench_embedding() {
 	
 	cout << "Embedding matrix specified." << endl;
 
+	// The input words are XOR-shared between the parties, as they would be if an upstream protocol produced them
 	srand(seed);
+	vector<uint64_t> input_shares(words_per_batch);
 	for (uint64_t sample_idx = 0; sample_idx < samples_per_batch; sample_idx ++) {
 		for (uint64_t word_idx = 0; word_idx < words_per_sample; word_idx ++) {
 			input_sentences[sample_idx][word_idx] = rand() % vocab_size; 
-			input_sentences_secret[sample_idx][word_idx] = Integer(input_bits + 1, input_sentences[sample_idx][word_idx], PUBLIC); 
+			uint64_t alice_share = rand() % (1 << input_bits);
+			input_shares[sample_idx * words_per_sample + word_idx] = party == ALICE ? alice_share : input_sentences[sample_idx][word_idx] ^ alice_share;
+		}
+	}
+	auto shared_words = from_xor_shares(input_shares, input_bits + 1, party);
+	for (uint64_t sample_idx = 0; sample_idx < samples_per_batch; sample_idx ++) {
+		for (uint64_t word_idx = 0; word_idx < words_per_sample; word_idx ++) {
+			input_sentences_secret[sample_idx][word_idx] = shared_words[sample_idx * words_per_sample + word_idx];
 		}
 	}
 	cout << "Input specified." << endl;
@@ -108,15 +122,37 @@ void bench_embedding() {
 	auto flattened_result = fable_lookup(flattened_input, lut_params, false);
 
 	vector<IntegerArray> result(samples_per_batch, IntegerArray(num_dimensions));
-
-	for (uint64_t sample_idx = 0; sample_idx < samples_per_batch; sample_idx ++) {
-		for (uint64_t dim_idx = 0; dim_idx < num_dimensions; dim_idx ++) {
-			result[sample_idx][dim_idx] = Integer(bits_per_element, 0);
+	// With arith, the embeddings are summed locally on additive shares mod 2^bits_per_element
+	vector<uint64_t> sum_shares(samples_per_batch * num_dimensions, 0);
+
+	if (arith) {
+		IntegerArray elements;
+		elements.reserve(words_per_batch * num_dimensions);
+		for (auto& packed_embedding : flattened_result) {
+			auto unpacked_result = unpack(packed_embedding);
+			elements.insert(elements.end(), unpacked_result.begin(), unpacked_result.end());
 		}
-		for (uint64_t word_idx = 0; word_idx < words_per_sample; word_idx ++) {
-			auto unpacked_result = unpack(flattened_result[sample_idx * words_per_sample + word_idx]);
+		start_record(io_gc, "Output Conversion");
+		ConversionContext conversion(party, io_gc);
+		auto shares = to_additive_shares(elements, conversion);
+		end_record(io_gc, "Output Conversion");
+		for (uint64_t sample_idx = 0; sample_idx < samples_per_batch; sample_idx ++) {
+			for (uint64_t word_idx = 0; word_idx < words_per_sample; word_idx ++) {
+				for (uint64_t dim_idx = 0; dim_idx < num_dimensions; dim_idx ++) {
+					sum_shares[sample_idx * num_dimensions + dim_idx] += shares[(sample_idx * words_per_sample + word_idx) * num_dimensions + dim_idx];
+				}
+			}
+		}
+	} else {
+		for (uint64_t sample_idx = 0; sample_idx < samples_per_batch; sample_idx ++) {
 			for (uint64_t dim_idx = 0; dim_idx < num_dimensions; dim_idx ++) {
-				result[sample_idx][dim_idx] = result[sample_idx][dim_idx] + unpacked_result[dim_idx];
+				result[sample_idx][dim_idx] = Integer(bits_per_element, 0);
+			}
+			for (uint64_t word_idx = 0; word_idx < words_per_sample; word_idx ++) {
+				auto unpacked_result = unpack(flattened_result[sample_idx * words_per_sample + word_idx]);
+				for (uint64_t dim_idx = 0; dim_idx < num_dimensions; dim_idx ++) {
+					result[sample_idx][dim_idx] = result[sample_idx][dim_idx] + unpacked_result[dim_idx];
+				}
 			}
 		}
 	}
@@ -126,9 +162,18 @@ void bench_embedding() {
 	// Verify
 	start_record(io_gc, "Verification");
 	std::array<std::array<uint16_t, num_dimensions>, samples_per_batch> plain_result;
+	vector<uint64_t> plain_sums;
+	vector<vector<uint64_t>> plain_table;
+	if (arith)
+		plain_sums = open_shares(sum_shares, bits_per_element, ALICE, party, io_gc);
+	else
+		plain_table = reveal_table(result, ALICE, party);
 	for (uint64_t sample_idx = 0; sample_idx < samples_per_batch; sample_idx ++) {
 		for (uint64_t dim_idx = 0; dim_idx < num_dimensions; dim_idx ++) {
-			plain_result[sample_idx][dim_idx] = result[sample_idx][dim_idx].reveal<uint32_t>(ALICE);
+			if (arith)
+				plain_result[sample_idx][dim_idx] = plain_sums[sample_idx * num_dimensions + dim_idx];
+			else
+				plain_result[sample_idx][dim_idx] = plain_table[sample_idx][dim_idx];
 		}
 	}
 	if (party == ALICE) {
@@ -164,15 +209,27 @@ int main(int argc, char **argv) {
 	amap.arg("seed", seed, "random seed");
 	amap.arg("par", parallel, "parallel flag: 1 = parallel; 0 = sequential");
 	amap.arg("thr", num_threads, "number of threads");
+	amap.arg("arith", arith, "1 = sum the embeddings on additive shares; 0 = with GC adders");
+	amap.arg("bw", bandwidth, "[BOB] emulated bandwidth in Mbps; 0 = unlimited");
+	amap.arg("rtt", rtt, "[BOB] emulated round-trip time in us");
+	amap.arg("jitter", jitter, "[BOB] emulated jitter in us");
+	amap.arg("json", json_file, "write the profiled phases to this JSON file");
+	amap.arg("csv", csv_file, "write the profiled phases to this CSV file");
 	amap.parse(argc-1, argv+1);
-	io_gc = new NetIO(party == ALICE ? nullptr : argv[1],
-						port + GC_PORT_OFFSET, true);
+	NetemRelay netem(argv[1], port + GC_PORT_OFFSET, party == BOB ? NetemOptions{bandwidth, rtt, jitter} : NetemOptions());
+	io_gc = new NetIO(party == ALICE ? nullptr : netem.host().c_str(),
+						netem.port(), true);
 
 	auto time_start = clock_start(); 
 	setup_semi_honest(io_gc, party);
+	install_counters();
 	auto time_span = time_from(time_start);
 	cout << "General setup: elapsed " << time_span / 1000 << " ms." << endl;
 	bench_embedding();
+	if (!json_file.empty())
+		dump_records_json(json_file);
+	if (!csv_file.empty())
+		dump_records_csv(csv_file);
 	delete io_gc;
 	return 0;
 }
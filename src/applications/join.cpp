@@ -2,14 +2,19 @@
 #include "LUT_utils.h"
 
 #include "GC/emp-sh2pc.h"
+#include "GC/conversion.h"
+#include "GC/share.h"
+#include "GC/gate_counter.h"
 #include "GC/lookup.h"
 #include "utils/io_utils.h"
+#include "utils/netem.h"
 #include <cstdint>
 
 using namespace sci;
 
 
-int party, port = 8000, parallel = 1, num_threads = 32, seed = 12345, baseline = 0;
+int party, port = 8000, parallel = 1, num_threads = 32, seed = 12345, baseline = 0, bandwidth = 0, rtt = 0, jitter = 0, arith = 1;
+std::string json_file, csv_file;
 NetIO *io_gc;
 
 typedef vector<uint32_t> PlainField;
@@ -26,46 +31,11 @@ const size_t acctbal_range = 1000;
 const size_t totalprice_range = 1000; 
 
 Table share(PlainTable& pt, int src_party) {
-	auto num_fields = pt.size();
-	auto num_rows = pt[0].size();
-
-	auto buffer = new bool[num_fields * num_rows * 32];
-	if (src_party == party) {
-		for (int field_idx = 0; field_idx < num_fields; field_idx++) {
-			for (int row_idx = 0; row_idx < num_rows; row_idx++) {
-				for (int i = 0; i < 32; i++) {
-					int_to_bool(buffer + (field_idx * num_rows + row_idx) * 32, pt[field_idx][row_idx], 32);
-				}
-			}
-		}
-	} else {
-		std::fill(buffer, buffer + num_fields * num_rows * 32, false);
-	}
-	vector<Bit> bits(num_fields * num_rows * 32);
-	// A trick to reduce rounds
-	prot_exec->feed((block128 *)bits.data(), src_party, buffer, num_fields * num_rows * 32); 
-	delete[] buffer;
-	
-	Table t(num_fields, IntegerArray(num_rows)); 
-	for (int field_idx = 0; field_idx < num_fields; field_idx++) {
-		for (int row_idx = 0; row_idx < num_rows; row_idx++) {
-			t[field_idx][row_idx].bits = vector<Bit>(bits.begin() + (field_idx * num_rows + row_idx) * 32, bits.begin() + (field_idx * num_rows + row_idx + 1) * 32);
-		}
-	}
-
-	return t;
+	return share_table(pt, vector<int>(pt.size(), 32), src_party, party);
 }
 
-PlainTable reveal(Table& t, int party) {
-	PlainTable pt; 
-	for (int field_idx = 0; field_idx < t.size(); field_idx++) {
-		PlainField field;
-		field.reserve(t[field_idx].size());
-		for (auto item : t[field_idx])
-			field.push_back(item.reveal<uint32_t>(party));
-		pt.push_back(field);
-	}
-	return pt;
+PlainTable reveal(Table& t, int to_party) {
+	return reveal_table<uint32_t>(t, to_party, party);
 }
 
 void print(PlainTable pt, string name) {
@@ -236,10 +206,22 @@ void bench_join() {
 	
 	start_record(io_gc, "Count");
 	Integer balance_insufficient(32, 0);
-	Integer zero(32, 0);
-	Integer one(32, 1);
-	for (int row_idx = 0; row_idx < final_aggregated_result[0].size(); row_idx++) {
-		balance_insufficient = balance_insufficient + If(final_aggregated_result[0][row_idx] < final_aggregated_result[1][row_idx], one, zero); 
+	// With arith, only the comparisons run in GC; their bits are counted locally on additive shares mod 2^32
+	uint64_t count_share = 0;
+	if (arith) {
+		BitArray insufficient(final_aggregated_result[0].size());
+		for (int row_idx = 0; row_idx < final_aggregated_result[0].size(); row_idx++) {
+			insufficient[row_idx] = final_aggregated_result[0][row_idx] < final_aggregated_result[1][row_idx];
+		}
+		ConversionContext conversion(party, io_gc);
+		for (auto share : to_additive_shares(insufficient, conversion, 32))
+			count_share += share;
+	} else {
+		Integer zero(32, 0);
+		Integer one(32, 1);
+		for (int row_idx = 0; row_idx < final_aggregated_result[0].size(); row_idx++) {
+			balance_insufficient = balance_insufficient + If(final_aggregated_result[0][row_idx] < final_aggregated_result[1][row_idx], one, zero); 
+		}
 	}
 	end_record(io_gc, "Count");
 	end_record(io_gc, "Join");
@@ -260,7 +242,7 @@ void bench_join() {
 	for (int row_idx = 0; row_idx < gt[0].size(); row_idx++) {
 		gt_violated += (gt[0][row_idx] < gt[1][row_idx]); 
 	}
-	auto plain_violated = balance_insufficient.reveal<uint32_t>(BOB);
+	uint32_t plain_violated = arith ? open_shares({count_share}, 32, BOB, party, io_gc)[0] : balance_insufficient.reveal<uint32_t>(BOB);
 	if (party == BOB)
 		check(gt_violated == plain_violated, fmt::format("{} != {}", plain_violated, gt_violated));
 
@@ -283,19 +265,31 @@ int main(int argc, char **argv) {
 	amap.arg("par", parallel, "parallel flag: 1 = parallel; 0 = sequential");
 	amap.arg("thr", num_threads, "number of threads");
 	amap.arg("baseline", baseline, "whether use baseline");
+	amap.arg("arith", arith, "1 = count on additive shares; 0 = with GC adders");
+	amap.arg("bw", bandwidth, "[BOB] emulated bandwidth in Mbps; 0 = unlimited");
+	amap.arg("rtt", rtt, "[BOB] emulated round-trip time in us");
+	amap.arg("jitter", jitter, "[BOB] emulated jitter in us");
+	amap.arg("json", json_file, "write the profiled phases to this JSON file");
+	amap.arg("csv", csv_file, "write the profiled phases to this CSV file");
 	amap.parse(argc-1, argv+1);
-	io_gc = new NetIO(party == ALICE ? nullptr : argv[1],
-						port + GC_PORT_OFFSET, true);
+	NetemRelay netem(argv[1], port + GC_PORT_OFFSET, party == BOB ? NetemOptions{bandwidth, rtt, jitter} : NetemOptions());
+	io_gc = new NetIO(party == ALICE ? nullptr : netem.host().c_str(),
+						netem.port(), true);
 
 	utils::check(LUT_INPUT_SIZE == 24, fmt::format("Please set LUT_INPUT_SIZE={}. ", 24)); 
 	utils::check(LUT_OUTPUT_SIZE == 32, fmt::format("Please set LUT_OUTPUT_SIZE={}. ", 32)); 
 	
 	auto time_start = clock_start(); 
 	setup_semi_honest(io_gc, party);
+	install_counters();
 	auto time_span = time_from(time_start);
 	cout << "General setup: elapsed " << time_span / 1000 << " ms." << endl;
 	// utils::check(type == 0, "Only PIRANA is supported now. "); 
 	bench_join();
+	if (!json_file.empty())
+		dump_records_json(json_file);
+	if (!csv_file.empty())
+		dump_records_csv(csv_file);
 	delete io_gc;
 	return 0;
 }
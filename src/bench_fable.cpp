@@ -1,53 +1,137 @@
 #include "LUT_utils.h"
 
 #include "GC/emp-sh2pc.h"
+#include "GC/cost_model.h"
+#include "GC/conversion.h"
+#include "GC/share.h"
+#include "GC/gate_counter.h"
+#include "GC/hybrid.h"
 #include "GC/lookup.h"
 #include "database_constants.h"
 #include "utils/io_utils.h"
+#include "utils/mux.h"
+#include "utils/netem.h"
 #include <cstdint>
+#include <limits>
+#include <random>
+#include <libOTe/Tools/Coproto.h>
 
 #include <signal.h>
 
 using namespace sci;
 using std::cout, std::endl, std::vector;
 
-int party, port = 8000, batch_size = 4096, db_size = (1 << LUT_INPUT_SIZE), parallel = 1, num_threads = 16, type = 0, lut_type = 0, hash_type = 0, fuse = 0, seed = 12345;
+int party, port = 8000, batch_size = 4096, db_size = (1 << LUT_INPUT_SIZE), parallel = 1, num_threads = 16, type = 0, lut_type = 0, hash_type = 0, fuse = 0, seed = 12345, num_shards = 1, numa = 0, model = 0, bandwidth = 0, rtt = 0, jitter = 0, mux = 0, compression = 0, engine = 0, xor_shared = 0;
+std::string json_file, csv_file, lut_file, profile_file, calib_file;
 NetIO *io_gc;
+std::unique_ptr<cp::AsioSocket> splut_chl;
 
+CostProfile cost_profile() {
+	CostProfile profile = profile_file.empty() ? CostProfile() : load_cost_profile(profile_file);
+	profile.num_threads = parallel ? num_threads : 1;
+	if (bandwidth > 0)
+		profile.bandwidth_mbps = bandwidth;
+	if (rtt > 0)
+		profile.rtt_ms = rtt / 1e3;
+	return profile;
+}
+
+// Compare the measured phases of the lookup with the cost model
+void report_model(FABLEShape& shape) {
+	auto profile = cost_profile();
+	auto records = get_records();
+	cout << fmt::format("{:<26}{:>24}{:>20}{:>20}{:>24}{:>20}", "phase (model / measured)", "AND", "OT", "reveal", "sent bytes", "ms") << endl;
+	for (auto& phase : predict_fable_cost(shape, profile)) {
+		for (auto& record : records) {
+			if (record.path != "FABLE Execution/" + phase.phase)
+				continue;
+			auto counter = [&](std::string name) { return record.counters.count(name) ? record.counters.at(name) : 0; };
+			cout << fmt::format("{:<26}{:>12}{:>12}{:>10}{:>10}{:>10}{:>10}{:>12}{:>12}{:>10.1f}{:>10.1f}", 
+				phase.phase, phase.and_gates, counter("and_gates"), phase.ot_bits, counter("ot_bits"), phase.revealed_bits, counter("revealed_bits"),
+				party == ALICE ? phase.alice_bytes : phase.bob_bytes, record.bytes_sent, phase.ms, record.wall_ms) << endl;
+		}
+	}
+}
 
+// Write the cost profile calibrated from the measured phases of the lookup. ALICE writes it, with the size of the query
+// ciphertexts BOB measured, since NetIO only counts sent bytes. 
+void write_calibration(FABLEShape& shape) {
+	// The spans ran over the emulated link, or over an unshaped one
+	auto base = cost_profile(), link = base;
+	if (bandwidth == 0)
+		link.bandwidth_mbps = std::numeric_limits<double>::infinity();
+	if (rtt == 0)
+		link.rtt_ms = 0;
+	auto profile = calibrate_cost_profile(shape, get_records(), party, link);
+	if (party == BOB) {
+		io_gc->send_data(&profile.query_ciphertext_bytes, sizeof(double));
+		io_gc->flush();
+		return;
+	}
+	io_gc->recv_data(&profile.query_ciphertext_bytes, sizeof(double));
+	profile.bandwidth_mbps = base.bandwidth_mbps;
+	profile.rtt_ms = base.rtt_ms;
+	save_cost_profile(calib_file, profile);
+	cout << fmt::format("Calibrated cost profile written to {}. ", calib_file) << endl;
+}
 
 void bench_lut() {
 	
-	auto lut = get_lut_vec((LUTType)lut_type, db_size, seed);
+	vector<uint64_t> lut;
+	if (lut_file.empty()) {
+		lut = get_lut_vec((LUTType)lut_type, db_size, seed);
+	} else {
+		// Both parties read the file, so that they agree on the LUT size
+		LUTFileHeader header;
+		lut = load_lut_binary(lut_file, &header);
+		utils::check(header.input_bits <= LUT_INPUT_SIZE && header.output_bits <= LUT_OUTPUT_SIZE, 
+			fmt::format("[FABLE] {} has {}-bit inputs and {}-bit outputs, but FABLE was built for {} and {}. ", lut_file, header.input_bits, header.output_bits, LUT_INPUT_SIZE, LUT_OUTPUT_SIZE));
+		db_size = lut.size();
+	}
 
-	start_record(io_gc, "Protocol Preparation");
-	
-	auto lut_params = fable_prepare(
-		lut, 
-		party, 
-		batch_size, 
-		db_size, 
-		parallel, 
-		num_threads, 
-		type, 
-		hash_type, 
-		io_gc
-	); 
-	
-	end_record(io_gc, "Protocol Preparation");
+	// With engine > 0, lookup() prepares the LUT itself
+	FABLEParams lut_params;
+	FABLEShape shape;
+	if (engine == 0) {
+		start_record(io_gc, "Protocol Preparation");
+		
+		lut_params = fable_prepare(
+			lut, 
+			party, 
+			batch_size, 
+			db_size, 
+			parallel, 
+			num_threads, 
+			type, 
+			hash_type, 
+			io_gc,
+			ShardOptions{num_shards, port, "", (bool)numa}
+		); 
+		
+		end_record(io_gc, "Protocol Preparation");
+		shape = fable_shape(lut_params.params, batch_size, lut.size(), num_shards, fuse);
+	}
 
 	start_record(io_gc, "Input Preparation");
 	// preparing queries
     vector<uint64_t> plain_queries(batch_size);
-    vector<Integer> secret_queries;
+    IntegerArray secret_queries;
+    vector<uint64_t> query_shares(batch_size);
+    std::mt19937_64 share_prng(seed);
     for (int i = 0; i < batch_size; i++) {
 		if (i < (batch_size + 1) / 2) {
 			plain_queries[i] = rand() % lut.size(); 
 		} else {
 			plain_queries[i] = plain_queries[rand() % ((batch_size + 1) / 2)]; // Force duplicates. 
 		}
-		secret_queries.emplace_back(DatabaseConstants::InputLength + 1, plain_queries[i], BOB);
+		if (xor_shared) {
+			// Both parties derive ALICE's share, which stands in for the output of an upstream protocol
+			uint64_t alice_share = share_prng() & ((1ULL << LUT_INPUT_SIZE) - 1);
+			query_shares[i] = party == ALICE ? alice_share : plain_queries[i] ^ alice_share;
+		}
 	}
+	if (!xor_shared)
+		secret_queries = share_column(plain_queries, DatabaseConstants::InputLength + 1, BOB, party);
 	end_record(io_gc, "Input Preparation");
 
 	// synchronize
@@ -57,15 +141,42 @@ void bench_lut() {
 	cout << BLUE << "FABLE Execution" << RESET << endl;
 	start_record(io_gc, "FABLE Execution");
 
-	auto result = fuse ? fable_lookup_fuse(secret_queries, lut_params, true) : fable_lookup(secret_queries, lut_params, true);
+	IntegerArray result;
+	vector<uint64_t> result_shares;
+	if (engine == 0 && xor_shared) {
+		result_shares = fable_lookup_xor(query_shares, lut_params, fuse, true);
+	} else if (engine == 0) {
+		result = fuse ? fable_lookup_fuse(secret_queries, lut_params, true) : fable_lookup(secret_queries, lut_params, true);
+	} else {
+		LookupOptions opts;
+		opts.engine = engine == 1 ? LookupEngine::splut : LookupEngine::automatic;
+		opts.splut_chl = splut_chl.get();
+		opts.parallel = parallel;
+		opts.num_threads = num_threads;
+		opts.type = type;
+		opts.hash_type = hash_type;
+		opts.fuse = fuse;
+		opts.shard_opts = ShardOptions{num_shards, port, "", (bool)numa};
+		opts.profile = cost_profile();
+		if (xor_shared)
+			result_shares = lookup(lut, query_shares, party, io_gc, opts, true);
+		else
+			result = lookup(lut, secret_queries, party, io_gc, opts, true);
+	}
 
 	end_record(io_gc, "FABLE Execution");
+	if (model && engine == 0)
+		report_model(shape);
+	if (!calib_file.empty() && engine == 0)
+		write_calibration(shape);
 
 	// Verify
 	start_record(io_gc, "Verification");
 	vector<uint64_t> plain_result(batch_size);
-	for (int i = 0; i < batch_size; i++) {
-		plain_result[i] = result[i].reveal<uint64_t>();
+	if (xor_shared) {
+		plain_result = open_shares(result_shares, 0, PUBLIC, party, io_gc);
+	} else {
+		plain_result = reveal_column(result, PUBLIC, party);
 	}
 	for(int batch_idx = 0; batch_idx < batch_size; ++batch_idx) {
 		check(
@@ -93,19 +204,76 @@ int main(int argc, char **argv) {
 	amap.arg("thr", num_threads, "number of threads");
 	amap.arg("t", type, "0 = PIRANA; 1 = UIUC");
 	amap.arg("l", lut_type, "0 = Random LUT; 1 = Gamma LUT");
+	amap.arg("lutfile", lut_file, "read the LUT from this packed binary file (see flutegen b=1) instead of generating it");
 	amap.arg("h", hash_type, "0 = LowMC; 1 = AES");
 	amap.arg("f", fuse, "0 = not fuse; 1 = fuse");
+	amap.arg("s", num_shards, "number of PIR server processes holding ALICE's LUT");
+	amap.arg("numa", numa, "1 = bind shard s to the (s % #nodes)-th online NUMA node");
+	amap.arg("model", model, "1 = compare every phase with the cost model");
+	amap.arg("profile", profile_file, "read the cost profile from this file (see calib); bw and rtt override it");
+	amap.arg("calib", calib_file, "write the cost profile calibrated from the measured phases to this file (e = 0); give it to both parties, ALICE writes it");
+	amap.arg("bw", bandwidth, "[BOB] emulated bandwidth in Mbps; 0 = unlimited");
+	amap.arg("rtt", rtt, "[BOB] emulated round-trip time in us");
+	amap.arg("jitter", jitter, "[BOB] emulated jitter in us");
+	amap.arg("mux", mux, "1 = carry the GC/PIR channel over a multiplexed connection on port p");
+	amap.arg("e", engine, "0 = FABLE; 1 = SPLUT+; 2 = chosen by the cost model");
+	amap.arg("xs", xor_shared, "1 = queries and results are XOR-shared words instead of GC integers");
+	amap.arg("z", compression, "compression of the PIR buffers sent by this party: 0 = none; 1 = zlib; 2 = zstd");
+	amap.arg("json", json_file, "write the profiled phases to this JSON file");
+	amap.arg("csv", csv_file, "write the profiled phases to this CSV file");
 	amap.parse(argc-1, argv+1);
-	io_gc = new NetIO(party == ALICE ? nullptr : argv[1],
-						port + GC_PORT_OFFSET, true);
+	NetemRelay netem(argv[1], mux ? port : port + GC_PORT_OFFSET, party == BOB ? NetemOptions{bandwidth, rtt, jitter} : NetemOptions());
+	std::string gc_host = netem.host();
+	int gc_port = netem.port();
+	std::unique_ptr<MuxTransport> transport;
+	vector<int> channel_ports{port + GC_PORT_OFFSET};
+	if (engine)
+		channel_ports.push_back(port + SPLUT_PORT_OFFSET);
+	if (mux) {
+		transport = std::make_unique<MuxTransport>(party, netem.host(), netem.port(), channel_ports);
+		transport->register_counters();
+		gc_host = "127.0.0.1";
+		gc_port = transport->local_port(0);
+	}
+	io_gc = new NetIO(party == ALICE ? nullptr : gc_host.c_str(),
+						gc_port, true);
+
+	// SPLUT+ runs over a coproto socket of its own, shaped like the GC channel
+	std::unique_ptr<NetemRelay> splut_netem;
+	if (engine) {
+		std::string splut_host = "127.0.0.1";
+		int splut_port = mux ? transport->local_port(1) : 0;
+		if (!mux) {
+			splut_netem = std::make_unique<NetemRelay>(argv[1], port + SPLUT_PORT_OFFSET, party == BOB ? NetemOptions{bandwidth, rtt, jitter} : NetemOptions());
+			splut_host = splut_netem->host();
+			splut_port = splut_netem->port();
+		}
+		splut_chl = std::make_unique<cp::AsioSocket>(cp::asioConnect(fmt::format("{}:{}", splut_host, splut_port), party == ALICE));
+	}
+
+	set_pir_compression((PIRCompression)compression);
 
 	auto time_start = clock_start(); 
 	setup_semi_honest(io_gc, party);
+	install_counters();
 	auto time_span = time_from(time_start);
 	cout << "General setup: elapsed " << time_span / 1000 << " ms." << endl;
-	cout << fmt::format("Running FABLE with batch size = {}, parallel = {}, num_threads = {}, type = {}, lut_type = {}, hash_type = {}, input_size = {}, output_size = {}", batch_size, parallel, num_threads, type, lut_type, hash_type, LUT_INPUT_SIZE, LUT_OUTPUT_SIZE) << endl;
+	cout << fmt::format("Running FABLE with batch size = {}, parallel = {}, num_threads = {}, type = {}, lut_type = {}, hash_type = {}, input_size = {}, output_size = {}, num_shards = {}", batch_size, parallel, num_threads, type, lut_type, hash_type, LUT_INPUT_SIZE, LUT_OUTPUT_SIZE, num_shards) << endl;
 	// utils::check(type == 0, "Only PIRANA is supported now. "); 
 	bench_lut();
+	if (compression)
+		cout << fmt::format("PIR compression saved {} Bytes. ", pir_compression_saved_bytes()) << endl;
+	if (transport) {
+		for (int channel = 0; channel < transport->num_channels(); channel++) {
+			auto stats = transport->stats(channel);
+			cout << fmt::format("Mux channel {}: sent {} Bytes, received {} Bytes in {} rounds. ", channel, stats.bytes_sent, stats.bytes_recv, stats.num_rounds) << endl;
+		}
+	}
+	if (!json_file.empty())
+		dump_records_json(json_file);
+	if (!csv_file.empty())
+		dump_records_csv(csv_file);
+	splut_chl.reset();
 	delete io_gc;
 	return 0;
 }
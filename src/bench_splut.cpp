@@ -6,6 +6,8 @@
 #include <libOTe/Tools/Coproto.h>
 #include <random>
 #include "utils/io_utils.h"
+#include "utils/netem.h"
+#include "OT/ot_pool.h"
 #include "OT/splut.h"
 #include "utils/ArgMapping/ArgMapping.h"
 #include "utils/ubuntu_terminal_colors.h"
@@ -19,11 +21,16 @@ bool verbose = true;
 int party = 1;
 int batch_size = 256;
 int lut_bitlength = 16;
+int lut_outlength = 0;
 int lut_type = 0;
 int num_threads = 1;
 string address = "127.0.0.1";
 int port = 32000;
 int seed = 12345;
+int bandwidth = 0, rtt = 0, jitter = 0;
+int max_memory_mb = 0;
+int use_pool = 0, reps = 1;
+string json_file, csv_file, lut_file;
 std::random_device rand_div;
 std::mt19937 generator(rand_div());
 
@@ -34,19 +41,43 @@ int main(int argc, char **argv) {
   amap.arg("p", port, "Port Number");
 	amap.arg("seed", seed, "random seed");
   amap.arg("len", lut_bitlength, "Bit Length");
+  amap.arg("lout", lut_outlength, "Output Bit Length, up to 64; 0 = len");
   amap.arg("bs", batch_size , "Batch Size");
   amap.arg("l", lut_type , "0 = Random LUT; 1 = Gamma LUT");
+  amap.arg("lutfile", lut_file, "read the LUT from this packed binary file (see flutegen b=1); len and lout are taken from it");
   amap.arg("thr", num_threads , "#Threads");
   amap.arg("ip", address, "IP Address of server (ALICE)");
+  amap.arg("bw", bandwidth, "[BOB] emulated bandwidth in Mbps; 0 = unlimited");
+  amap.arg("rtt", rtt, "[BOB] emulated round-trip time in us");
+  amap.arg("jitter", jitter, "[BOB] emulated jitter in us");
+  amap.arg("mem", max_memory_mb, "[ALICE] memory for the online phase buffers in MiB; 0 = half of the system memory");
+  amap.arg("pool", use_pool, "1 = take the OTs from a background silent OT pool, set up once for all repetitions");
+  amap.arg("reps", reps, "number of SPLUT+ calls");
+  amap.arg("json", json_file, "write the profiled phases to this JSON file");
+  amap.arg("csv", csv_file, "write the profiled phases to this CSV file");
   amap.parse(argc, argv);
+  // Both parties read the file, so that they agree on len and lout
+  vector<uint64_t> lut;
+  if (!lut_file.empty()) {
+    LUTFileHeader header;
+    lut = load_lut_binary(lut_file, &header);
+    lut_bitlength = header.input_bits;
+    lut_outlength = header.output_bits;
+  }
+  if (lut_outlength == 0)
+    lut_outlength = lut_bitlength;
 
-  cout << fmt::format("Testing SPLUT with parameters bit_length={}, batch_size = {}, lut_type = {}, num_threads = {}", lut_bitlength, batch_size, lut_type, num_threads) << endl;
+  cout << fmt::format("Testing SPLUT with parameters bit_length={}, out_length={}, batch_size = {}, lut_type = {}, num_threads = {}", lut_bitlength, lut_outlength, batch_size, lut_type, num_threads) << endl;
 
-  auto ip = address+":"+std::to_string(port);
+  NetemRelay netem(address, port, party == BOB ? NetemOptions{bandwidth, rtt, jitter} : NetemOptions());
+  auto ip = netem.host()+":"+std::to_string(netem.port());
   auto chl = cp::asioConnect(ip, party == ALICE);
 
   auto lut_size = 1ULL << lut_bitlength;
-	auto lut = get_lut_vec((LUTType)lut_type, lut_size, seed, lut_bitlength, lut_bitlength);
+  if (lut_file.empty())
+    lut = get_lut_vec((LUTType)lut_type, lut_size, seed, lut_bitlength, lut_outlength);
+  // SPLUT+ reads all 2^len entries
+  lut.resize(lut_size, 0);
   
   vector<uint32_t> plain_queries(batch_size);
   vector<uint32_t> input(batch_size);
@@ -66,24 +97,56 @@ int main(int argc, char **argv) {
     assert (input[i] < lut_size);
   }
 
-  auto ret = SPLUT(lut, input, lut_bitlength, lut_bitlength, party, chl, num_threads);
-  cout << "Execution end. " << endl;
+  std::unique_ptr<SilentOTPool> pool;
+  if (use_pool) {
+    pool = std::make_unique<SilentOTPool>(party == ALICE ? Role::Sender : Role::Receiver, chl.fork(), num_threads);
+    set_silent_ot_pool(pool.get());
+  }
 
-  // Verify
-  if (party == ALICE) {
-    std::vector<uint32_t> ret_client(batch_size);
-    cp::sync_wait(chl.recv(ret_client));
-    for (int i = 0; i < batch_size; i++) {
-        auto recovered_result = ret[i] ^ ret_client[i];
-        if (recovered_result != (lut[plain_queries[i]])) {
-          cout << RED << "SPLUT+ test failed" << RESET << endl;
-          std::cerr << "Mismatch at " << i << " " << recovered_result << " " << lut[plain_queries[i]] << std::endl;
-          exit(1);
-        }
+  for (int rep = 0; rep < reps; rep++) {
+    // Outputs wider than 32 bits go through the 64-bit engine
+    std::vector<uint64_t> ret;
+    if (lut_outlength > 32) {
+      ret = SPLUT_wide<uint64_t>(lut, input, lut_outlength, lut_bitlength, party, chl, num_threads, (uint64_t)max_memory_mb << 20);
+    } else {
+      auto ret32 = SPLUT(lut, input, lut_outlength, lut_bitlength, party, chl, num_threads, (uint64_t)max_memory_mb << 20);
+      ret.assign(ret32.begin(), ret32.end());
     }
-  } else {
-    cp::sync_wait(chl.send(ret));
+
+    // Verify
+    if (party == ALICE) {
+      std::vector<uint64_t> ret_client(batch_size);
+      cp::sync_wait(chl.recv(ret_client));
+      for (int i = 0; i < batch_size; i++) {
+          auto recovered_result = ret[i] ^ ret_client[i];
+          if (recovered_result != (lut[plain_queries[i]])) {
+            cout << RED << "SPLUT+ test failed" << RESET << endl;
+            std::cerr << "Mismatch at " << i << " " << recovered_result << " " << lut[plain_queries[i]] << std::endl;
+            exit(1);
+          }
+      }
+    } else {
+      cp::sync_wait(chl.send(ret));
+    }
+  }
+  cout << "Execution end. " << endl;
+  // BOB derives his 1-out-of-N messages from the 1-out-of-2 OTs up front. ALICE only expands the AES keys up front,
+  // and derives her messages while packing the online phase, so her rate is not comparable and is not reported.
+  if (party == BOB) {
+    double derivation_ms = 0;
+    for (auto& record : get_records())
+      if (record.tag == "OT Derivation")
+        derivation_ms += record.wall_ms;
+    uint64_t derived_ots = (uint64_t)reps * batch_size * lut_bitlength;
+    cout << fmt::format("OT derivation (client): {} 1-out-of-2 OTs in {:.1f} ms, {:.2f} M OTs/s. ",
+      derived_ots, derivation_ms, derived_ots / std::max(derivation_ms, 1e-3) / 1e3) << endl;
   }
+  if (pool)
+    cout << fmt::format("OT pool: {} batches of silent OTs. ", pool->batches()) << endl;
+  if (!json_file.empty())
+    dump_records_json(json_file);
+  if (!csv_file.empty())
+    dump_records_csv(csv_file);
 
   cout << GREEN << "SPLUT+ test passed" << RESET << endl;
 
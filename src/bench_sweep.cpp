@@ -0,0 +1,299 @@
+#include "GC/emp-sh2pc.h"
+#include "utils/ArgMapping/ArgMapping.h"
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+extern char **environ;
+
+using std::cout, std::endl, std::string, std::vector;
+
+// Runs fable and/or splut over loopback for every combination of the swept parameters, and collects the
+// profiled phases of both parties (see dump_records_csv) into a single JSON and CSV file. The JSON has one object
+// per run, holding its parameters, whether both parties succeeded, and the phases of each party; the CSV has one
+// row per (run, party, phase) with the swept parameters as columns, ready to be grouped and plotted.
+// With bw / rtt / jitter set, BOB reaches ALICE through its in-process network emulation (see utils/netem.h).
+
+string protocols = "fable", bs_list = "4096", db_list = "", h_list = "0", t_list = "0", f_list = "0", thr_list = "16", len_list = "16";
+string bin_dir = "", out = "sweep";
+int port = 9000, reps = 3, bandwidth = 0, rtt = 0, jitter = 0, par = 1, lut_type = 0, timeout_s = 600;
+
+static vector<string> split(const string& list, char sep = ',') {
+	vector<string> items;
+	std::stringstream ss(list);
+	string item;
+	while (std::getline(ss, item, sep))
+		if (!item.empty())
+			items.push_back(item);
+	return items;
+}
+
+// Splits one line of dump_records_csv, whose strings are quoted with "" as escape
+static vector<string> split_csv(const string& line) {
+	vector<string> fields(1);
+	bool quoted = false;
+	for (size_t i = 0; i < line.size(); i++) {
+		char c = line[i];
+		if (quoted) {
+			if (c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+				fields.back() += '"';
+				i++;
+			} else if (c == '"') {
+				quoted = false;
+			} else {
+				fields.back() += c;
+			}
+		} else if (c == '"') {
+			quoted = true;
+		} else if (c == ',') {
+			fields.emplace_back();
+		} else {
+			fields.back() += c;
+		}
+	}
+	return fields;
+}
+
+static string self_dir() {
+	char buf[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+	utils::check(len > 0, "[Sweep] Cannot locate the running executable. ");
+	string exe(buf, len);
+	return exe.substr(0, exe.find_last_of('/'));
+}
+
+struct RunConfig {
+	string protocol;
+	std::map<string, string> params; // swept parameter -> value
+};
+
+// All combinations of the swept parameters of a protocol
+static vector<RunConfig> expand(const string& protocol, const vector<std::pair<string, string>>& axes) {
+	vector<RunConfig> configs{RunConfig{protocol, {}}};
+	for (auto& [name, list] : axes) {
+		auto values = split(list);
+		if (values.empty())
+			continue;
+		vector<RunConfig> expanded;
+		for (auto& config : configs) {
+			for (auto& value : values) {
+				expanded.push_back(config);
+				expanded.back().params[name] = value;
+			}
+		}
+		configs = expanded;
+	}
+	return configs;
+}
+
+static pid_t spawn(const vector<string>& args, const string& log_file) {
+	vector<char*> argv;
+	for (auto& arg : args)
+		argv.push_back((char*)arg.c_str());
+	argv.push_back(nullptr);
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+	pid_t pid;
+	utils::check(posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ) == 0, fmt::format("[Sweep] Cannot spawn {}. ", args[0]));
+	posix_spawn_file_actions_destroy(&actions);
+	return pid;
+}
+
+static vector<string> read_csv(const string& filename, vector<string>& header) {
+	vector<string> lines;
+	std::ifstream in(filename);
+	string line;
+	if (std::getline(in, line))
+		header = split_csv(line);
+	while (std::getline(in, line))
+		if (!line.empty())
+			lines.push_back(line);
+	return lines;
+}
+
+// Waits for both parties. Once one of them fails, or the run exceeds timeout_s, the other one would block on its
+// socket forever, so it is killed. Returns whether both parties exited with 0.
+static bool wait_parties(pid_t pids[2], int timeout_s) {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_s);
+	bool running[2] = {true, true}, ok = true;
+	while (running[0] || running[1]) {
+		for (int i = 0; i < 2; i++) {
+			int status;
+			if (!running[i] || waitpid(pids[i], &status, WNOHANG) != pids[i])
+				continue;
+			running[i] = false;
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				ok = false;
+		}
+		bool expired = std::chrono::steady_clock::now() >= deadline;
+		if ((!ok || expired) && (running[0] || running[1])) {
+			if (expired)
+				cout << fmt::format("[Sweep] Run timed out after {} s. ", timeout_s) << endl;
+			for (int i = 0; i < 2; i++) {
+				if (running[i]) {
+					kill(pids[i], SIGKILL);
+					waitpid(pids[i], nullptr, 0);
+					running[i] = false;
+				}
+			}
+			ok = false;
+		}
+		if (running[0] || running[1])
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return ok;
+}
+
+// CSV strings are quoted, with "" for an embedded quote, as split_csv expects
+static string csv_string(const string& str) {
+	string escaped = "\"";
+	for (char c : str) {
+		if (c == '"')
+			escaped += '"';
+		escaped += c;
+	}
+	return escaped + "\"";
+}
+
+static string json_string(const string& str) {
+	string escaped = "\"";
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped + "\"";
+}
+
+int main(int argc, char **argv) {
+
+	ArgMapping amap;
+	amap.arg("proto", protocols, "protocols to run, e.g. fable,splut");
+	amap.arg("bs", bs_list, "batch sizes, e.g. 1024,4096");
+	amap.arg("db", db_list, "[fable] LUT sizes; empty = exp2(LUT_INPUT_SIZE)");
+	amap.arg("h", h_list, "[fable] OPRF types: 0 = LowMC; 1 = AES");
+	amap.arg("t", t_list, "[fable] PIR types: 0 = PIRANA; 1 = UIUC");
+	amap.arg("f", f_list, "[fable] fuse modes");
+	amap.arg("len", len_list, "[splut] LUT bit lengths");
+	amap.arg("thr", thr_list, "thread counts");
+	amap.arg("par", par, "[fable] parallel flag");
+	amap.arg("l", lut_type, "LUT type");
+	amap.arg("reps", reps, "repetitions of every configuration");
+	amap.arg("timeout", timeout_s, "seconds before a run is killed and marked as failed");
+	amap.arg("bw", bandwidth, "bandwidth in Mbps; 0 = unlimited");
+	amap.arg("rtt", rtt, "round-trip time in us");
+	amap.arg("jitter", jitter, "jitter in us");
+	amap.arg("p", port, "base port");
+	amap.arg("bin", bin_dir, "directory of the fable / splut executables; default: next to this executable");
+	amap.arg("out", out, "output prefix: writes <out>.json, <out>.csv and the party logs in <out>_logs/");
+	amap.parse(argc, argv);
+
+	if (bin_dir.empty())
+		bin_dir = self_dir();
+	string log_dir = out + "_logs";
+	mkdir(log_dir.c_str(), 0755);
+
+	vector<RunConfig> configs;
+	for (auto& protocol : split(protocols)) {
+		if (protocol == "fable") {
+			auto fable_configs = expand("fable", {{"bs", bs_list}, {"db", db_list}, {"h", h_list}, {"t", t_list}, {"f", f_list}, {"thr", thr_list}});
+			configs.insert(configs.end(), fable_configs.begin(), fable_configs.end());
+		} else if (protocol == "splut") {
+			auto splut_configs = expand("splut", {{"bs", bs_list}, {"len", len_list}, {"thr", thr_list}});
+			configs.insert(configs.end(), splut_configs.begin(), splut_configs.end());
+		} else {
+			utils::check(false, fmt::format("[Sweep] Unknown protocol {}. ", protocol));
+		}
+	}
+	cout << fmt::format("Sweeping {} configurations x {} repetitions, bandwidth = {} Mbps, rtt = {} us, jitter = {} us", configs.size(), reps, bandwidth, rtt, jitter) << endl;
+
+	std::ofstream json(out + ".json"), csv(out + ".csv");
+	json << fmt::format("{{\"bandwidth_mbps\": {}, \"rtt_us\": {}, \"jitter_us\": {}, \"runs\": [", bandwidth, rtt, jitter);
+	csv << "protocol,run,rep,party,ok,bs,db,h,t,f,len,thr,tag,path,thread,depth,start_ms,wall_ms,cpu_ms,bytes_sent,bytes_recv,rounds,peak_rss_kb,counters\n";
+	vector<string> param_names{"bs", "db", "h", "t", "f", "len", "thr"};
+	int run_idx = 0;
+	for (auto& config : configs) {
+		for (int rep = 0; rep < reps; rep++, run_idx++) {
+			// Fresh ports for every run, so that sockets in TIME_WAIT do not get in the way
+			int run_port = port + 10 * (run_idx % 200);
+
+			string run_name = fmt::format("{}/run{}", log_dir, run_idx);
+			pid_t pids[2];
+			for (int party = ALICE; party <= BOB; party++) {
+				string csv_file = fmt::format("{}_{}.csv", run_name, party);
+				vector<string> args{bin_dir + "/" + config.protocol};
+				if (config.protocol == "fable")
+					args.push_back("127.0.0.1");
+				args.push_back(fmt::format("r={}", party));
+				args.push_back(fmt::format("p={}", run_port));
+				args.push_back(fmt::format("l={}", lut_type));
+				if (config.protocol == "fable")
+					args.push_back(fmt::format("par={}", par));
+				for (auto& [name, value] : config.params)
+					args.push_back(fmt::format("{}={}", name, value));
+				if (party == BOB)
+					args.insert(args.end(), {fmt::format("bw={}", bandwidth), fmt::format("rtt={}", rtt), fmt::format("jitter={}", jitter)});
+				args.push_back("csv=" + csv_file);
+				std::remove(csv_file.c_str());
+				pids[party - 1] = spawn(args, fmt::format("{}_{}.log", run_name, party));
+			}
+			bool ok = wait_parties(pids, timeout_s);
+
+			string params_json;
+			for (auto& [name, value] : config.params)
+				params_json += fmt::format("{}{}: {}", params_json.empty() ? "" : ", ", json_string(name), value);
+			json << fmt::format("{}\n    {{\"protocol\": {}, \"run\": {}, \"rep\": {}, \"ok\": {}, \"params\": {{{}}}, \"phases\": {{",
+				run_idx ? "," : "", json_string(config.protocol), run_idx, rep, ok ? "true" : "false", params_json);
+			for (int party = ALICE; party <= BOB; party++) {
+				vector<string> header;
+				auto lines = read_csv(fmt::format("{}_{}.csv", run_name, party), header);
+				json << fmt::format("{}\n      \"{}\": [", party == ALICE ? "" : ",", party == ALICE ? "ALICE" : "BOB");
+				for (size_t line_idx = 0; line_idx < lines.size(); line_idx++) {
+					auto fields = split_csv(lines[line_idx]);
+					fields.resize(std::max(fields.size(), (size_t)11));
+					// Counters differ between protocols, so the CSV folds them into a single "name=value;..." column
+					string counters, counters_json;
+					for (size_t i = 11; i < fields.size() && i < header.size(); i++) {
+						if (fields[i].empty())
+							continue;
+						counters += fmt::format("{}{}={}", counters.empty() ? "" : ";", header[i], fields[i]);
+						counters_json += fmt::format("{}{}: {}", counters_json.empty() ? "" : ", ", json_string(header[i]), fields[i]);
+					}
+					csv << fmt::format("{},{},{},{},{}", config.protocol, run_idx, rep, party, (int)ok);
+					for (auto& name : param_names)
+						csv << "," << (config.params.count(name) ? config.params[name] : "");
+					csv << fmt::format(",{},{},{},{},{},{},{},{},{},{},{},{}\n", csv_string(fields[0]), csv_string(fields[1]), fields[2], fields[3],
+						fields[4], fields[5], fields[6], fields[7], fields[8], fields[9], fields[10], csv_string(counters));
+
+					auto number = [](const string& value) { return value == "-1" ? string("null") : value; };
+					json << fmt::format("{}\n        {{\"tag\": {}, \"path\": {}, \"thread\": {}, \"depth\": {}, \"start_ms\": {}, \"wall_ms\": {}, \"cpu_ms\": {}, "
+						"\"bytes_sent\": {}, \"bytes_recv\": {}, \"rounds\": {}, \"peak_rss_kb\": {}, \"counters\": {{{}}}}}",
+						line_idx ? "," : "", json_string(fields[0]), json_string(fields[1]), fields[2], fields[3], fields[4], fields[5], fields[6],
+						number(fields[7]), number(fields[8]), number(fields[9]), fields[10], counters_json);
+				}
+				json << (lines.empty() ? "]" : "\n      ]");
+			}
+			json << "\n    }}";
+			cout << fmt::format("[{}/{}] {} {} rep {}: {}", run_idx + 1, configs.size() * reps, config.protocol, config.params, rep, ok ? "ok" : "FAILED") << endl;
+		}
+	}
+	json << "\n]}\n";
+	return 0;
+}
@@ -0,0 +1,51 @@
+#include "GC/cost_model.h"
+#include "GC/shard.h"
+#include "utils/ArgMapping/ArgMapping.h"
+#include <fmt/core.h>
+#include <iostream>
+
+using namespace sci;
+using std::cout, std::endl;
+
+// Predicts the cost of every FABLE phase for a configuration, without running the protocol. 
+
+std::string profile_file;
+int batch_size = 4096, db_size = (1 << LUT_INPUT_SIZE), parallel = 1, num_threads = 16, type = 0, hash_type = 0, fuse = 0, num_shards = 1, bandwidth = 1000, rtt = 100;
+
+int main(int argc, char **argv) {
+
+	ArgMapping amap;
+	amap.arg("bs", batch_size, "batch size");
+	amap.arg("db", db_size, "database size");
+	amap.arg("par", parallel, "parallel flag: 1 = parallel; 0 = sequential");
+	amap.arg("thr", num_threads, "number of threads");
+	amap.arg("t", type, "0 = PIRANA; 1 = UIUC");
+	amap.arg("h", hash_type, "0 = LowMC; 1 = AES");
+	amap.arg("f", fuse, "0 = not fuse; 1 = fuse");
+	amap.arg("s", num_shards, "number of PIR server processes holding ALICE's LUT");
+	amap.arg("bw", bandwidth, "bandwidth in Mbps");
+	amap.arg("rtt", rtt, "round-trip time in us");
+	amap.arg("profile", profile_file, "read the cost profile from this file (see bench_fable calib); bw and rtt override it");
+	amap.parse(argc, argv);
+
+	// Shards hold db / s rows on average, and take shard_batch_size queries each
+	uint64_t shard_db_size = ((uint64_t)db_size + num_shards - 1) / num_shards;
+	BatchPirParams params(shard_batch_size(batch_size, num_shards), shard_db_size, parallel, num_threads, (BatchPirType)type, (HashType)hash_type);
+	auto shape = fable_shape(&params, batch_size, db_size, num_shards, fuse);
+
+	CostProfile profile = profile_file.empty() ? CostProfile() : load_cost_profile(profile_file);
+	profile.bandwidth_mbps = bandwidth;
+	profile.rtt_ms = rtt / 1e3;
+	profile.num_threads = parallel ? num_threads : 1;
+
+	cout << fmt::format("FABLE cost model: batch size = {}, buckets = {}, db = {}, shards = {}, hash_type = {}, fuse = {}, bandwidth = {} Mbps, rtt = {} us", 
+		shape.batch_size, shape.num_buckets, shape.db_size, shape.num_shards, shape.hash_type, fuse, bandwidth, rtt) << endl;
+	cout << fmt::format("{:<26}{:>14}{:>12}{:>12}{:>8}{:>14}{:>14}{:>8}{:>12}", "phase", "AND", "OT", "reveal", "HE ct", "ALICE bytes", "BOB bytes", "rounds", "ms") << endl;
+	auto phases = predict_fable_cost(shape, profile);
+	phases.push_back(total_cost(phases));
+	for (auto& phase : phases) {
+		cout << fmt::format("{:<26}{:>14}{:>12}{:>12}{:>8}{:>14}{:>14}{:>8}{:>12.1f}", 
+			phase.phase, phase.and_gates, phase.ot_bits, phase.revealed_bits, phase.he_ciphertexts, phase.alice_bytes, phase.bob_bytes, phase.rounds, phase.ms) << endl;
+	}
+	return 0;
+}
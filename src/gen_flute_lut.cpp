@@ -5,7 +5,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
-int lut_type = LUTType::Filled, input_bits = 16, output_bits = 16, test=false;
+int lut_type = LUTType::Filled, input_bits = 16, output_bits = 16, test=false, binary=false, seed=12345;
 
 inline std::map<uint64_t, uint64_t> get_lut_test() {
     std::vector<uint64_t> lut_content{
@@ -91,6 +91,10 @@ inline string dump_flute_lut(std::map<uint64_t, uint64_t> lut, int input_bits, i
     return header + body;
 }
 
+inline void report_lut_error(const LUTErrorStats& error, uint64_t lut_size) {
+    std::cout << fmt::format("{} LUT, {} entries: max abs error {:.3e}, max rel error {:.3e}", lut_type_to_string((LUTType)lut_type), lut_size, error.max_abs_error, error.max_rel_error) << std::endl;
+}
+
 int main(int argc, char** argv) {
 
     ArgMapping amap;
@@ -98,6 +102,8 @@ int main(int argc, char** argv) {
     amap.arg("t", lut_type, "LUTType: Random = 0; Gamma = 1, Filled = 2 (Default: 2)");
     amap.arg("i", input_bits, "Number of input bits (Default: 16)");
     amap.arg("o", output_bits, "Number of output bits (Default: 16)");
+    amap.arg("b", binary, "Dump a packed binary LUT instead of a FLUTE netlist (Default: 0)");
+    amap.arg("seed", seed, "random seed");
     amap.parse(argc, argv);
 
     utils::check(lut_type < NumLUTTypes && lut_type >= 0, "Invalid LUT type");
@@ -108,13 +114,24 @@ int main(int argc, char** argv) {
         string filename = fmt::format("flute_luts/LUT_test.lut", input_bits, output_bits, lut_type_to_string((LUTType)lut_type));
         std::ofstream out(filename);
         out << dump_flute_lut(get_lut_test(), 8, 8);
+    } else if (binary) {
+        string filename = fmt::format("flute_luts/LUT_{}_{}_{}.bin", input_bits, output_bits, lut_type_to_string((LUTType)lut_type));
+        // The error is accumulated tile by tile while the file is written, so memory stays bounded by one tile
+        auto error = dump_lut_binary(filename, (LUTType)lut_type, 1ULL << input_bits, seed, input_bits, output_bits);
+        report_lut_error(error, 1ULL << input_bits);
     } else {
-        auto lut = get_lut_map((LUTType)lut_type, input_bits, output_bits);
+        auto lut = get_lut_map((LUTType)lut_type, 1ULL << input_bits, seed, input_bits, output_bits);
 
         string filename = fmt::format("flute_luts/LUT_{}_{}_{}.lut", input_bits, output_bits, lut_type_to_string((LUTType)lut_type));
         std::ofstream out(filename);
 
         out << dump_flute_lut(lut, input_bits, output_bits);
+
+        std::vector<uint64_t> lut_vec;
+        lut_vec.reserve(lut.size());
+        for (auto& entry : lut)
+            lut_vec.push_back(entry.second);
+        report_lut_error(get_lut_error((LUTType)lut_type, lut_vec, output_bits), lut.size());
     }
 
     return 0;
@@ -0,0 +1,101 @@
+#include "GC/lookup.h"
+#include "GC/shard.h"
+#include "utils/io_utils.h"
+#include "utils/numa_utils.h"
+#include <cstdint>
+
+#include <signal.h>
+
+using namespace sci;
+using std::cout, std::endl, std::vector;
+
+// A pirshard worker holds one shard of ALICE's LUT and answers the queries routed to it in a FABLE lookup. 
+// It is spawned by PIRShardCoordinator and serves a single lookup. 
+
+int port = 8000, node = -1;
+
+int main(int argc, char **argv) {
+
+	signal(SIGSEGV, handler);
+
+	ArgMapping amap;
+	amap.arg("p", port, "Port Number");
+	amap.arg("node", node, "NUMA node to bind to; -1 = unbound");
+	amap.parse(argc-1, argv+1);
+
+	// Bind before anything is allocated, so that the encoded database is first touched on the node. Exiting before
+	// connecting makes the coordinator fail, instead of silently running an unbound shard.
+	if (node >= 0 && !numa_bind_node(node)) {
+		std::cerr << fmt::format("[Shard] Failed to bind to NUMA node {}. ", node) << std::endl;
+		return 1;
+	}
+	NetIO* io = new NetIO(argv[1], port, true);
+
+	ShardSpec spec;
+	io->recv_data(&spec, sizeof(ShardSpec));
+	if (node >= 0)
+		spec.num_threads = std::min<int>(spec.num_threads, std::max<size_t>(1, numa_node_cpus(node).size()));
+	std::map<uint64_t, uint64_t> lut;
+	vector<uint64_t> keys, values;
+	for (uint64_t begin = 0; begin < spec.num_rows; begin += SHARD_ROW_CHUNK) {
+		uint64_t count = std::min<uint64_t>(SHARD_ROW_CHUNK, spec.num_rows - begin);
+		keys.resize(count);
+		values.resize(count);
+		io->recv_data(keys.data(), count * sizeof(uint64_t));
+		io->recv_data(values.data(), count * sizeof(uint64_t));
+		for (uint64_t row_idx = 0; row_idx < count; row_idx++)
+			lut.emplace_hint(lut.end(), keys[row_idx], values[row_idx]);
+	}
+
+	auto params = new BatchPirParams(spec.batch_size, spec.db_size, spec.parallel, spec.num_threads, (BatchPirType)spec.type, (HashType)spec.hash_type);
+	osuCrypto::PRNG prng(osuCrypto::sysRandomSeed());
+	auto batch_server = new BatchPIRServer(*params, prng);
+	batch_server->populate_raw_db(lut);
+	lut.clear();
+
+	auto glk_buffer = recv_bytes(io);
+	auto rlk_buffer = recv_bytes(io);
+	batch_server->set_client_keys(client_id, {glk_buffer, rlk_buffer});
+
+	if (params->get_hash_type() == HashType::LowMC) {
+		auto lowmc_key = recv_bitset<keyblock().size()>(io);
+		auto lowmc_prefix = recv_bitset<prefixblock().size()>(io);
+		batch_server->lowmc_prepare(lowmc_key, lowmc_prefix);
+	} else {
+		oc::block aes_key;
+		io->recv_data(&aes_key, sizeof(oc::block));
+		auto aes_prefix = recv_bitset<128-DatabaseConstants::InputLength>(io);
+		batch_server->aes_prepare(aes_key, aes_prefix);
+	}
+	batch_server->initialize();
+
+	auto query_buffer = recv_query(io, params);
+	auto time_start = clock_start();
+	auto queries = batch_server->deserialize_query(query_buffer);
+	vector<PIRResponseList> responses = batch_server->generate_response(client_id, queries);
+	auto response_buffer = batch_server->serialize_response(responses);
+	double answer_ms = time_from(time_start) / 1000;
+
+	const int w = DatabaseConstants::NumHashFunctions;
+	int num_bucket = params->get_num_buckets();
+	MaskBits masks(w * num_bucket * datablock_size);
+	for (int hash_idx = 0; hash_idx < w; hash_idx++) {
+		for (int bucket_idx = 0; bucket_idx < num_bucket; bucket_idx++) {
+			auto mask = masks.data() + (hash_idx * num_bucket + bucket_idx) * datablock_size;
+			for (int i = 0; i < DatabaseConstants::InputLength; i++)
+				mask[i] = batch_server->index_masks[hash_idx][bucket_idx][i];
+			for (int i = 0; i < datablock_size - DatabaseConstants::InputLength; i++)
+				mask[DatabaseConstants::InputLength + i] = batch_server->entry_masks[hash_idx][bucket_idx][i];
+		}
+	}
+
+	send_response(io, params, response_buffer);
+	io->send_data(masks.data(), masks.size());
+	io->send_data(&answer_ms, sizeof(double));
+	io->flush();
+
+	delete batch_server;
+	delete params;
+	delete io;
+	return 0;
+}
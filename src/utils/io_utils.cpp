@@ -1,53 +1,228 @@
 #include "io_utils.h"
+#include <atomic>
 #include <chrono>
+#include <fstream>
+#include <mutex>
+#include <set>
 #include <fmt/format.h>
+#include <sys/resource.h>
+#include <time.h>
 
+namespace {
 
-std::map<string, recordinfo> record; 
-std::map<string, time_point<system_clock, nanoseconds>> start_timestamps;
+struct snapshot {
+    steady_clock::time_point wall;
+    double cpu_ms;
+    int64_t bytes_sent, bytes_recv, num_rounds;
+    std::vector<uint64_t> counters;
+};
+
+struct open_record {
+    std::string tag;
+    std::string path;
+    int depth;
+    snapshot start;
+};
+
+std::mutex record_mutex;
+std::vector<recordinfo> records;
+std::vector<std::pair<std::string, std::function<uint64_t()>>> counters;
+const steady_clock::time_point epoch = steady_clock::now();
+
+std::atomic<int> num_threads_seen{0};
+thread_local int thread_idx = num_threads_seen++;
+thread_local std::vector<open_record> open_records;
+// start_timing/end_timing keep one process-wide timer per prefix, which may be started and stopped on different threads
+std::mutex timing_mutex;
+std::map<std::string, time_point<high_resolution_clock, nanoseconds>> start_timestamps;
+
+double cpu_time_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int64_t peak_rss_kb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+snapshot take_snapshot(int64_t bytes_sent, int64_t bytes_recv, int64_t num_rounds) {
+    snapshot snap{steady_clock::now(), cpu_time_ms(), bytes_sent, bytes_recv, num_rounds, {}};
+    std::lock_guard<std::mutex> lock(record_mutex);
+    for (auto& [name, read] : counters)
+        snap.counters.push_back(read());
+    return snap;
+}
+
+void open(std::string tag, int64_t bytes_sent, int64_t bytes_recv, int64_t num_rounds) {
+    std::string path = open_records.empty() ? tag : open_records.back().path + "/" + tag;
+    int depth = open_records.size();
+    open_records.push_back({tag, path, depth, take_snapshot(bytes_sent, bytes_recv, num_rounds)});
+}
+
+int64_t delta(int64_t end, int64_t start) {
+    return (end < 0 || start < 0) ? -1 : end - start;
+}
+
+// Closes the innermost open span with the given tag. Returns false if there is none. 
+bool close(std::string tag, int64_t bytes_sent, int64_t bytes_recv, int64_t num_rounds, recordinfo& info) {
+    snapshot end = take_snapshot(bytes_sent, bytes_recv, num_rounds);
+    auto it = open_records.rbegin();
+    while (it != open_records.rend() && it->tag != tag)
+        it++;
+    if (it == open_records.rend()) {
+        std::cerr << fmt::format("[Profiler] end_record(\"{}\") without a matching start_record. ", tag) << std::endl;
+        return false;
+    }
+    snapshot start = std::move(it->start);
+    info.tag = tag;
+    info.path = it->path;
+    info.thread = thread_idx;
+    info.depth = it->depth;
+    info.start_ms = duration<double, std::milli>(start.wall - epoch).count();
+    info.wall_ms = duration<double, std::milli>(end.wall - start.wall).count();
+    info.cpu_ms = end.cpu_ms - start.cpu_ms;
+    info.bytes_sent = delta(end.bytes_sent, start.bytes_sent);
+    info.bytes_recv = delta(end.bytes_recv, start.bytes_recv);
+    info.num_rounds = delta(end.num_rounds, start.num_rounds);
+    info.peak_rss_kb = peak_rss_kb();
+    open_records.erase(std::next(it).base());
+    std::lock_guard<std::mutex> lock(record_mutex);
+    for (size_t i = 0; i < start.counters.size(); i++)
+        info.counters[counters[i].first] = end.counters[i] - start.counters[i];
+    records.push_back(info);
+    return true;
+}
+
+std::string json_string(const std::string& str) {
+    std::string escaped = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+std::string json_int(int64_t value) {
+    return value < 0 ? "null" : std::to_string(value);
+}
+
+std::string csv_string(const std::string& str) {
+    std::string escaped = "\"";
+    for (char c : str) {
+        if (c == '"')
+            escaped += '"';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+} // namespace
 
 void start_record(sci::NetIO* io, std::string tag) {
-    recordinfo info;
-    info.counter = io->counter;
-    info.num_rounds = io->num_rounds;
-    info.start_time = std::chrono::system_clock::now();
-    record[tag] = info;
+    open(tag, io->counter, -1, io->num_rounds);
 }
 
 void end_record(sci::NetIO* io, std::string tag, bool verbose) {
-    auto end_time = std::chrono::system_clock::now();
-    auto start_time = record[tag].start_time;
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-    if (verbose)
-        std::cout << fmt::format("{}: \n    elapsed {} ms,\n    sent {} Bytes in {} rounds. ", tag, duration.count(), io->counter - record[tag].counter, (io->num_rounds - record[tag].num_rounds)) << std::endl;
-    record.erase(tag);
+    recordinfo info;
+    if (close(tag, io->counter, -1, io->num_rounds, info) && verbose)
+        std::cout << fmt::format("{}: \n    elapsed {} ms,\n    sent {} Bytes in {} rounds. ", tag, (int64_t)info.wall_ms, info.bytes_sent, info.num_rounds) << std::endl;
 }
 
 void start_record(coproto::AsioSocket &chl, std::string tag) {
-    recordinfo info;
-    info.counter = chl.bytesSent() + chl.bytesReceived();
-    info.num_rounds = 0;
-    info.start_time = std::chrono::system_clock::now();
-    record[tag] = info;
+    open(tag, chl.bytesSent(), chl.bytesReceived(), -1);
 }
+
 void end_record(coproto::AsioSocket &chl, std::string tag, bool verbose) {
-    auto end_time = std::chrono::system_clock::now();
-    auto start_time = record[tag].start_time;
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-    if (verbose)
-        std::cout << fmt::format("{}: \n    elapsed {} ms,\n    sent {} Bytes. ", tag, duration.count(), chl.bytesSent() + chl.bytesReceived() - record[tag].counter) << std::endl;
-    record.erase(tag);
+    recordinfo info;
+    if (close(tag, chl.bytesSent(), chl.bytesReceived(), -1, info) && verbose)
+        std::cout << fmt::format("{}: \n    elapsed {} ms,\n    sent {} Bytes. ", tag, (int64_t)info.wall_ms, info.bytes_sent + info.bytes_recv) << std::endl;
+}
+
+void start_record(std::string tag) {
+    open(tag, -1, -1, -1);
+}
+
+void end_record(std::string tag, bool verbose) {
+    recordinfo info;
+    if (close(tag, -1, -1, -1, info) && verbose)
+        std::cout << fmt::format("{}: \n    elapsed {} ms. ", tag, (int64_t)info.wall_ms) << std::endl;
+}
+
+void register_counter(std::string name, std::function<uint64_t()> read) {
+    std::lock_guard<std::mutex> lock(record_mutex);
+    counters.emplace_back(name, read);
 }
 
-void start_timing(string prefix) {
-    start_timestamps[prefix] = high_resolution_clock::now();
+std::vector<recordinfo> get_records() {
+    std::lock_guard<std::mutex> lock(record_mutex);
+    return records;
 }
 
-double end_timing(string prefix, bool verbose) {
+void dump_records_json(std::string filename) {
+    std::ofstream out(filename);
+    out << "[\n";
+    auto all_records = get_records();
+    for (size_t i = 0; i < all_records.size(); i++) {
+        auto& info = all_records[i];
+        out << fmt::format("  {{\"tag\": {}, \"path\": {}, \"thread\": {}, \"depth\": {}, \"start_ms\": {:.3f}, \"wall_ms\": {:.3f}, \"cpu_ms\": {:.3f}, \"bytes_sent\": {}, \"bytes_recv\": {}, \"rounds\": {}, \"peak_rss_kb\": {}, \"counters\": {{",
+            json_string(info.tag), json_string(info.path), info.thread, info.depth, info.start_ms, info.wall_ms, info.cpu_ms,
+            json_int(info.bytes_sent), json_int(info.bytes_recv), json_int(info.num_rounds), info.peak_rss_kb);
+        bool first = true;
+        for (auto& [name, value] : info.counters) {
+            out << fmt::format("{}{}: {}", first ? "" : ", ", json_string(name), value);
+            first = false;
+        }
+        out << "}}" << (i + 1 < all_records.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+void dump_records_csv(std::string filename) {
+    auto all_records = get_records();
+    std::set<std::string> counter_names;
+    for (auto& info : all_records)
+        for (auto& [name, value] : info.counters)
+            counter_names.insert(name);
+
+    std::ofstream out(filename);
+    out << "tag,path,thread,depth,start_ms,wall_ms,cpu_ms,bytes_sent,bytes_recv,rounds,peak_rss_kb";
+    for (auto& name : counter_names)
+        out << "," << csv_string(name);
+    out << "\n";
+    for (auto& info : all_records) {
+        out << fmt::format("{},{},{},{},{:.3f},{:.3f},{:.3f},{},{},{},{}",
+            csv_string(info.tag), csv_string(info.path), info.thread, info.depth, info.start_ms, info.wall_ms, info.cpu_ms,
+            info.bytes_sent, info.bytes_recv, info.num_rounds, info.peak_rss_kb);
+        for (auto& name : counter_names) {
+            auto it = info.counters.find(name);
+            out << ",";
+            if (it != info.counters.end())
+                out << it->second;
+        }
+        out << "\n";
+    }
+}
+
+void start_timing(std::string prefix) {
+    auto start = high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(timing_mutex);
+    start_timestamps[prefix] = start;
+}
+
+double end_timing(std::string prefix, bool verbose) {
     auto end = high_resolution_clock::now();
-    auto duration_init = duration_cast<nanoseconds>(end - start_timestamps[prefix]);
+    time_point<high_resolution_clock, nanoseconds> start;
+    {
+        std::lock_guard<std::mutex> lock(timing_mutex);
+        start = start_timestamps[prefix];
+        start_timestamps.erase(prefix);
+    }
+    auto duration_init = duration_cast<nanoseconds>(end - start);
     if (verbose)
         std::cout << fmt::format("{}: {} ms. ", prefix, duration_init.count() * 1.0 / 1e6) << std::endl;
-    start_timestamps.erase(prefix);
     return duration_init.count() * 1.0 / 1e6;
-}
\ No newline at end of file
+}
@@ -3,8 +3,11 @@
 
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <string>
+#include <vector>
 #include <utils/net_io_channel.h>
 #include <coproto/Socket/AsioSocket.h>
 
@@ -12,18 +15,43 @@
 
 using namespace std::chrono;
 using std::cout, std::endl;
+
+// One closed span of the profiler. Spans nest per thread: path joins the tags of all enclosing spans with '/'.
+// Channel statistics that the channel cannot report (received bytes of a NetIO, rounds of a coproto socket) are -1.
 struct recordinfo {
-  uint64_t counter;
-  uint64_t num_rounds;
-  std::chrono::time_point<std::chrono::system_clock> start_time;
+  std::string tag;
+  std::string path;
+  int thread;
+  int depth;
+  double start_ms;     // since the first span of the process
+  double wall_ms;
+  double cpu_ms;       // process CPU time, i.e., summed over all threads
+  int64_t bytes_sent;
+  int64_t bytes_recv;
+  int64_t num_rounds;
+  int64_t peak_rss_kb; // at the end of the span
+  std::map<std::string, uint64_t> counters; // deltas of the registered counters
 };
 
+// Spans are opened and closed by tag on the calling thread; they may nest and may close out of order. 
 void start_record(sci::NetIO* io, std::string tag);
 void end_record(sci::NetIO* io, std::string tag, bool verbose = true);
 
 void start_record(coproto::AsioSocket &chl, std::string tag);
 void end_record(coproto::AsioSocket &chl, std::string tag, bool verbose = true);
 
+// Spans without a channel, e.g., for local computation
+void start_record(std::string tag);
+void end_record(std::string tag, bool verbose = true);
+
+// Adds a monotonic counter (e.g., garbled AND gates) whose delta is recorded in every span closed afterwards
+void register_counter(std::string name, std::function<uint64_t()> read);
+
+// All spans closed so far, in closing order
+std::vector<recordinfo> get_records();
+void dump_records_json(std::string filename);
+void dump_records_csv(std::string filename);
+
 void start_timing(std::string prefix);
 double end_timing(std::string prefix, bool verbose = true);
 
@@ -40,4 +68,4 @@ inline void handler(int sig) {
   exit(1);
 }
 
-#endif
\ No newline at end of file
+#endif
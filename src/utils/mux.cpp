@@ -0,0 +1,347 @@
+#include "mux.h"
+#include "io_utils.h"
+#include <fmt/format.h>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+enum MuxFrameType : uint8_t { MUX_OPEN = 0, MUX_DATA = 1, MUX_CLOSE = 2, MUX_CREDIT = 3 };
+
+#pragma pack(push, 1)
+struct MuxFrameHeader {
+    uint16_t channel;
+    uint8_t type;
+    uint32_t len;
+};
+#pragma pack(pop)
+
+// Bytes in flight per channel; local readers wait (and thus apply backpressure) beyond it. The receiver returns
+// credit in steps of a quarter window, so that credit frames stay rare.
+const uint64_t MUX_WINDOW_BYTES = 16 << 20;
+const uint64_t MUX_CREDIT_STEP = MUX_WINDOW_BYTES / 4;
+const int MUX_CONNECT_ATTEMPTS = 6000;
+
+static sockaddr_in mux_address(const std::string& host, int port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (host.empty()) {
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        return addr;
+    }
+    addrinfo hints{}, *info;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &info) != 0)
+        throw std::runtime_error(fmt::format("[Mux] Cannot resolve {}. ", host));
+    addr.sin_addr = ((sockaddr_in*)info->ai_addr)->sin_addr;
+    freeaddrinfo(info);
+    return addr;
+}
+
+static int connect_retry(const sockaddr_in& addr) {
+    for (int attempt = 0; attempt < MUX_CONNECT_ATTEMPTS; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+            int nodelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            return fd;
+        }
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+static int listen_on(sockaddr_in addr, int& port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    socklen_t len = sizeof(addr);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0 || getsockname(fd, (sockaddr*)&addr, &len) != 0)
+        throw std::runtime_error(fmt::format("[Mux] Cannot listen on port {}. ", port));
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static bool read_all(int fd, void* buf, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        ssize_t n = recv(fd, (char*)buf + done, len - done, 0);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void* buf, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        ssize_t n = send(fd, (const char*)buf + done, len - done, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+MuxTransport::MuxTransport(int party, std::string host, int port, std::vector<int> channel_ports)
+    : party(party), channel_ports(channel_ports) {
+    for (size_t c = 0; c < channel_ports.size(); c++) {
+        channels.push_back(std::make_unique<Channel>());
+        channels.back()->send_credit = MUX_WINDOW_BYTES;
+    }
+
+    if (party == 1) {
+        int listen_port = port;
+        int listen_fd = listen_on(mux_address("", port), listen_port);
+        mux_fd = accept(listen_fd, nullptr, nullptr);
+        close(listen_fd);
+        int nodelay = 1;
+        setsockopt(mux_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    } else {
+        mux_fd = connect_retry(mux_address(host, port));
+        // The applications connect to ephemeral loopback ports, one per channel
+        for (size_t c = 0; c < channels.size(); c++) {
+            auto& channel = *channels[c];
+            channel.listen_fd = listen_on(mux_address("127.0.0.1", 0), channel.local_port);
+            std::lock_guard<std::mutex> lock(openers_mutex);
+            openers.emplace_back([this, c]() { open_channel(c); });
+        }
+    }
+    if (mux_fd < 0)
+        throw std::runtime_error(fmt::format("[Mux] Cannot connect to {}:{}. ", host, port));
+
+    mux_reader = std::thread([this]() { read_mux(); });
+    mux_writer = std::thread([this]() { write_mux(); });
+}
+
+MuxTransport::~MuxTransport() {
+    // Channels end when the applications close them; channels the application never opened are given up
+    for (auto& channel : channels)
+        if (channel->listen_fd >= 0)
+            shutdown(channel->listen_fd, SHUT_RDWR);
+    join_openers();
+    for (auto& channel : channels)
+        if (channel->reader.joinable())
+            channel->reader.join();
+    {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        out_closed = true;
+        out_cv.notify_all();
+    }
+    mux_writer.join();
+    shutdown(mux_fd, SHUT_WR);
+    mux_reader.join();
+    join_openers();
+    for (auto& channel : channels) {
+        if (channel->reader.joinable())
+            channel->reader.join();
+        {
+            std::lock_guard<std::mutex> lock(channel->mutex);
+            channel->peer_closed = true;
+            channel->cv.notify_all();
+        }
+        if (channel->writer.joinable())
+            channel->writer.join();
+        if (channel->local_fd >= 0)
+            close(channel->local_fd);
+        if (channel->listen_fd >= 0)
+            close(channel->listen_fd);
+    }
+    close(mux_fd);
+}
+
+void MuxTransport::join_openers() {
+    while (true) {
+        std::vector<std::thread> pending;
+        {
+            std::lock_guard<std::mutex> lock(openers_mutex);
+            pending.swap(openers);
+        }
+        if (pending.empty())
+            return;
+        for (auto& opener : pending)
+            opener.join();
+    }
+}
+
+int MuxTransport::local_port(int channel) const {
+    return party == 1 ? channel_ports[channel] : channels[channel]->local_port;
+}
+
+MuxChannelStats MuxTransport::stats(int channel) const {
+    auto& c = *channels[channel];
+    return MuxChannelStats{c.bytes_sent, c.bytes_recv, c.num_rounds};
+}
+
+void MuxTransport::register_counters(std::string prefix) {
+    for (size_t c = 0; c < channels.size(); c++) {
+        auto channel = channels[c].get();
+        register_counter(fmt::format("{}{}_sent", prefix, c), [channel]() { return channel->bytes_sent.load(); });
+        register_counter(fmt::format("{}{}_recv", prefix, c), [channel]() { return channel->bytes_recv.load(); });
+        register_counter(fmt::format("{}{}_rounds", prefix, c), [channel]() { return channel->num_rounds.load(); });
+    }
+}
+
+// ALICE connects to her local server when BOB opens the channel; BOB waits for his application to connect
+void MuxTransport::open_channel(int c) {
+    auto& channel = *channels[c];
+    int fd;
+    if (party == 1) {
+        fd = connect_retry(mux_address("127.0.0.1", channel_ports[c]));
+        if (fd < 0) {
+            std::cerr << fmt::format("[Mux] Cannot connect channel {} to port {}. ", c, channel_ports[c]) << std::endl;
+            enqueue(c, MUX_CLOSE, nullptr, 0);
+            return;
+        }
+    } else {
+        fd = accept(channel.listen_fd, nullptr, nullptr);
+        if (fd < 0)
+            return;
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        enqueue(c, MUX_OPEN, nullptr, 0);
+    }
+    {
+        std::lock_guard<std::mutex> lock(channel.mutex);
+        channel.local_fd = fd;
+    }
+    channel.reader = std::thread([this, c]() { read_local(c); });
+    channel.writer = std::thread([this, c]() { write_local(c); });
+}
+
+void MuxTransport::enqueue(uint16_t c, uint8_t type, const char* data, uint32_t len) {
+    std::vector<char> frame(sizeof(MuxFrameHeader) + len);
+    MuxFrameHeader header{c, type, len};
+    memcpy(frame.data(), &header, sizeof(header));
+    if (len)
+        memcpy(frame.data() + sizeof(header), data, len);
+    std::lock_guard<std::mutex> lock(out_mutex);
+    if (type == MUX_CREDIT)
+        control.push_back(std::move(frame));
+    else
+        channels[c]->outbox.push_back(std::move(frame));
+    out_frames++;
+    out_cv.notify_all();
+}
+
+void MuxTransport::read_local(int c) {
+    auto& channel = *channels[c];
+    std::vector<char> buf(1 << 16);
+    while (true) {
+        ssize_t n = recv(channel.local_fd, buf.data(), buf.size(), 0);
+        if (n <= 0)
+            break;
+        {
+            std::unique_lock<std::mutex> lock(channel.mutex);
+            channel.cv.wait(lock, [&]() { return channel.send_credit >= (uint64_t)n || channel.mux_closed; });
+            if (channel.send_credit < (uint64_t)n)
+                break;
+            channel.send_credit -= n;
+        }
+        if (channel.last_was_recv.exchange(false))
+            channel.num_rounds++;
+        channel.bytes_sent += n;
+        enqueue(c, MUX_DATA, buf.data(), n);
+    }
+    enqueue(c, MUX_CLOSE, nullptr, 0);
+}
+
+void MuxTransport::write_local(int c) {
+    auto& channel = *channels[c];
+    uint32_t delivered = 0;
+    while (true) {
+        std::vector<char> data;
+        {
+            std::unique_lock<std::mutex> lock(channel.mutex);
+            channel.cv.wait(lock, [&]() { return channel.peer_closed || !channel.inbox.empty(); });
+            if (channel.inbox.empty())
+                break;
+            data = std::move(channel.inbox.front());
+            channel.inbox.pop_front();
+        }
+        if (!write_all(channel.local_fd, data.data(), data.size()))
+            break;
+        delivered += data.size();
+        if (delivered >= MUX_CREDIT_STEP) {
+            enqueue(c, MUX_CREDIT, (const char*)&delivered, sizeof(delivered));
+            delivered = 0;
+        }
+    }
+    shutdown(channel.local_fd, SHUT_WR);
+}
+
+void MuxTransport::read_mux() {
+    while (true) {
+        MuxFrameHeader header;
+        if (!read_all(mux_fd, &header, sizeof(header)) || header.channel >= channels.size())
+            break;
+        auto& channel = *channels[header.channel];
+        std::vector<char> data(header.len);
+        if (!read_all(mux_fd, data.data(), data.size()))
+            break;
+        if (header.type == MUX_OPEN) {
+            std::lock_guard<std::mutex> lock(openers_mutex);
+            openers.emplace_back([this, c = header.channel]() { open_channel(c); });
+        } else if (header.type == MUX_CREDIT) {
+            uint32_t credit = 0;
+            memcpy(&credit, data.data(), std::min(data.size(), sizeof(credit)));
+            std::lock_guard<std::mutex> lock(channel.mutex);
+            channel.send_credit += credit;
+            channel.cv.notify_all();
+        } else {
+            if (header.type == MUX_DATA) {
+                channel.bytes_recv += data.size();
+                channel.last_was_recv = true;
+            }
+            std::lock_guard<std::mutex> lock(channel.mutex);
+            if (header.type == MUX_DATA)
+                channel.inbox.push_back(std::move(data));
+            else
+                channel.peer_closed = true;
+            channel.cv.notify_all();
+        }
+    }
+    // Local readers waiting for credit would wait forever
+    for (auto& channel : channels) {
+        std::lock_guard<std::mutex> lock(channel->mutex);
+        channel->mux_closed = true;
+        channel->cv.notify_all();
+    }
+}
+
+// Credit frames go first; data frames are taken round-robin, one frame per channel
+void MuxTransport::write_mux() {
+    while (true) {
+        std::vector<char> frame;
+        {
+            std::unique_lock<std::mutex> lock(out_mutex);
+            out_cv.wait(lock, [&]() { return out_closed || out_frames > 0; });
+            if (out_frames == 0)
+                break;
+            if (!control.empty()) {
+                frame = std::move(control.front());
+                control.pop_front();
+            } else {
+                for (size_t i = 0; i < channels.size(); i++) {
+                    auto& outbox = channels[(next_channel + i) % channels.size()]->outbox;
+                    if (outbox.empty())
+                        continue;
+                    frame = std::move(outbox.front());
+                    outbox.pop_front();
+                    next_channel = (next_channel + i + 1) % channels.size();
+                    break;
+                }
+            }
+            out_frames--;
+        }
+        if (!write_all(mux_fd, frame.data(), frame.size()))
+            break;
+    }
+}
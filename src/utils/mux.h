@@ -0,0 +1,93 @@
+#ifndef FABLE_MUX_H__
+#define FABLE_MUX_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Carries several logical channels between the two parties over a single TCP connection, so that e.g. GC label
+// streaming, HE ciphertexts and OT traffic share one port and overlap on the wire. The channels are ordinary
+// loopback TCP connections on each side, so NetIO and coproto sockets work unchanged:
+// - ALICE accepts the mux connection on port, and connects channel c to her local server at channel_ports[c]
+//   as soon as BOB opens it (i.e., ALICE's NetIO / coproto socket listens on channel_ports[c] as usual);
+// - BOB connects to host:port, and his NetIO / coproto socket connects to 127.0.0.1:local_port(c).
+// Every channel has its own send queue, and the mux writer takes one frame from each non-empty queue in turn, so
+// small GC / OT frames are never stuck behind a bulk transfer on another channel. Per channel, at most
+// MUX_WINDOW_BYTES are in flight (queued, on the wire, or received but not yet delivered to the application);
+// the receiver grants more as its application reads, which bounds both queues.
+//
+// This is a relay in front of unmodified blocking channels, not multiplexing inside the IO layer, and it has a cost:
+// - every channel runs a reader and a writer thread on each side, plus one reader and one writer for the mux socket;
+// - every byte crosses an extra loopback TCP hop on each side, i.e., one more send/recv pair and copy;
+// - NetIO and coproto calls still block as before: the mux only interleaves channels that the application already
+//   drives from separate threads, it does not make a single caller asynchronous.
+// It keeps the SCI / libOTe channel classes untouched, which a NetIO subclass writing to the outboxes would not.
+
+struct MuxChannelStats {
+    uint64_t bytes_sent;
+    uint64_t bytes_recv;
+    uint64_t num_rounds; // times this party started sending on the channel after receiving on it
+};
+
+class MuxTransport {
+public:
+    // party: 1 = ALICE, 2 = BOB, as in SCI
+    MuxTransport(int party, std::string host, int port, std::vector<int> channel_ports);
+    ~MuxTransport();
+
+    int local_port(int channel) const;
+    MuxChannelStats stats(int channel) const;
+    int num_channels() const { return channels.size(); }
+
+    // Registers <prefix><c>_sent / _recv / _rounds of every channel with the profiler
+    void register_counters(std::string prefix = "mux");
+
+private:
+    struct Channel {
+        int local_fd = -1;       // application side
+        int listen_fd = -1;      // BOB: where the application connects
+        int local_port = 0;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::vector<char>> inbox; // received from the peer, to be written to local_fd
+        bool peer_closed = false;
+        uint64_t send_credit;                // bytes this side may still send before the peer grants more
+        bool mux_closed = false;             // the peer is gone, so no more credit will come
+        std::deque<std::vector<char>> outbox; // framed, to be written to mux_fd; guarded by out_mutex
+        std::atomic<uint64_t> bytes_sent{0}, bytes_recv{0}, num_rounds{0};
+        std::atomic<bool> last_was_recv{true};
+        std::thread reader, writer;
+    };
+
+    void open_channel(int channel);
+    void join_openers();
+    void read_local(int channel);
+    void write_local(int channel);
+    void read_mux();
+    void write_mux();
+    void enqueue(uint16_t channel, uint8_t type, const char* data, uint32_t len);
+
+    int party;
+    int mux_fd = -1;
+    std::vector<int> channel_ports;
+    std::vector<std::unique_ptr<Channel>> channels;
+
+    std::mutex out_mutex;
+    std::condition_variable out_cv;
+    std::deque<std::vector<char>> control; // credit frames, sent ahead of all data
+    size_t out_frames = 0;                 // in control and all outboxes
+    size_t next_channel = 0;               // where the round-robin over the outboxes resumes
+    bool out_closed = false;
+
+    std::thread mux_reader, mux_writer;
+    std::mutex openers_mutex;
+    std::vector<std::thread> openers;
+};
+
+#endif
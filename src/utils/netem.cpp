@@ -0,0 +1,165 @@
+#include "netem.h"
+#include <fmt/format.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using steady = std::chrono::steady_clock;
+
+// Extra bytes queued on top of the bandwidth-delay product, like the buffer of a router
+const size_t NETEM_BUFFER_BYTES = 4 << 20;
+const int NETEM_CONNECT_ATTEMPTS = 6000;
+
+static sockaddr_in resolve(const std::string& host, int port) {
+    addrinfo hints{}, *info;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &info) != 0)
+        throw std::runtime_error(fmt::format("[Netem] Cannot resolve {}. ", host));
+    sockaddr_in addr = *(sockaddr_in*)info->ai_addr;
+    freeaddrinfo(info);
+    addr.sin_port = htons(port);
+    return addr;
+}
+
+NetemRelay::NetemRelay(std::string host, int port, NetemOptions opts)
+    : opts(opts), target_host(host), local_host(host), target_port(port), local_port(port) {
+    if (!opts.enabled())
+        return;
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0 || getsockname(listen_fd, (sockaddr*)&addr, &len) != 0)
+        throw std::runtime_error("[Netem] Cannot open the relay socket. ");
+    local_host = "127.0.0.1";
+    local_port = ntohs(addr.sin_port);
+    std::cout << fmt::format("[Netem] {}:{} through a link with {} Mbps, rtt {} us, jitter {} us", target_host, target_port, opts.bandwidth_mbps, opts.rtt_us, opts.jitter_us) << std::endl;
+    acceptor = std::thread([this]() { accept_loop(); });
+}
+
+NetemRelay::~NetemRelay() {
+    if (listen_fd < 0)
+        return;
+    shutdown(listen_fd, SHUT_RDWR);
+    close(listen_fd);
+    acceptor.join();
+    for (auto& pump : pumps)
+        pump.join();
+    for (int fd : fds)
+        close(fd);
+}
+
+void NetemRelay::accept_loop() {
+    sockaddr_in target = resolve(target_host, target_port);
+    while (true) {
+        int client_fd = accept(listen_fd, nullptr, nullptr);
+        if (client_fd < 0)
+            return;
+        // The server may still be starting up
+        int server_fd = -1;
+        for (int attempt = 0; attempt < NETEM_CONNECT_ATTEMPTS && server_fd < 0; attempt++) {
+            server_fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (connect(server_fd, (sockaddr*)&target, sizeof(target)) != 0) {
+                close(server_fd);
+                server_fd = -1;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        if (server_fd < 0) {
+            std::cerr << fmt::format("[Netem] Cannot connect to {}:{}. ", target_host, target_port) << std::endl;
+            close(client_fd);
+            continue;
+        }
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        setsockopt(server_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        fds.push_back(client_fd);
+        fds.push_back(server_fd);
+        unsigned seed = pumps.size();
+        pumps.emplace_back([this, client_fd, server_fd, seed]() { pump(client_fd, server_fd, seed); });
+        pumps.emplace_back([this, client_fd, server_fd, seed]() { pump(server_fd, client_fd, seed + 1); });
+    }
+}
+
+// Moves bytes from -> to until from is closed. The reader stamps every chunk with its delivery time; the writer
+// releases the chunks on time. 
+void NetemRelay::pump(int from, int to, unsigned seed) {
+    struct Chunk {
+        steady::time_point deliver_at;
+        std::vector<char> data;
+    };
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Chunk> queue;
+    size_t queued_bytes = 0;
+    bool closed = false;
+    size_t max_queued = (size_t)opts.bandwidth_mbps * opts.rtt_us / 8 + NETEM_BUFFER_BYTES;
+
+    std::thread writer([&]() {
+        while (true) {
+            Chunk chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return closed || !queue.empty(); });
+                if (queue.empty())
+                    break;
+                chunk = std::move(queue.front());
+                queue.pop_front();
+            }
+            std::this_thread::sleep_until(chunk.deliver_at);
+            for (size_t sent = 0; sent < chunk.data.size(); ) {
+                ssize_t n = send(to, chunk.data.data() + sent, chunk.data.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0)
+                    break;
+                sent += n;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            queued_bytes -= chunk.data.size();
+            cv.notify_all();
+        }
+        shutdown(to, SHUT_WR);
+    });
+
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> jitter(-opts.jitter_us, opts.jitter_us);
+    auto link_free = steady::now(), last_delivery = steady::now();
+    std::vector<char> buf(1 << 16);
+    while (true) {
+        ssize_t n = recv(from, buf.data(), buf.size(), 0);
+        if (n <= 0)
+            break;
+        link_free = std::max(link_free, steady::now());
+        if (opts.bandwidth_mbps > 0)
+            link_free += std::chrono::nanoseconds((int64_t)(n * 8e3 / opts.bandwidth_mbps));
+        int64_t delay_us = std::max(0, opts.rtt_us / 2 + (opts.jitter_us ? jitter(gen) : 0));
+        // TCP does not reorder, so a chunk never overtakes the previous one
+        last_delivery = std::max(last_delivery, link_free + std::chrono::microseconds(delay_us));
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return queued_bytes < max_queued; });
+        queue.push_back({last_delivery, std::vector<char>(buf.begin(), buf.begin() + n)});
+        queued_bytes += n;
+        cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        cv.notify_all();
+    }
+    writer.join();
+}
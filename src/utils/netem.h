@@ -0,0 +1,45 @@
+#ifndef FABLE_NETEM_H__
+#define FABLE_NETEM_H__
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// In-process network emulation, so that LAN/WAN numbers can be reproduced on one machine without tc or root. 
+
+struct NetemOptions {
+    int bandwidth_mbps = 0; // 0 = unlimited
+    int rtt_us = 0;
+    int jitter_us = 0;      // every chunk gets an extra one-way delay drawn uniformly from [-jitter, jitter]
+
+    bool enabled() const { return bandwidth_mbps > 0 || rtt_us > 0 || jitter_us > 0; }
+};
+
+// Relays connections to host:port through a shaped link. Each direction is paced at the bandwidth and delayed by
+// rtt/2 (plus jitter) without reordering; at most one bandwidth-delay product plus a small buffer is queued, so the
+// sender sees backpressure as on a real link. Only the connecting party needs a relay, since it shapes both
+// directions. With shaping disabled, host() and port() are passed through unchanged. 
+class NetemRelay {
+public:
+    NetemRelay(std::string host, int port, NetemOptions opts);
+    ~NetemRelay();
+
+    // Where to connect to instead of host:port
+    const std::string& host() const { return local_host; }
+    int port() const { return local_port; }
+
+private:
+    void accept_loop();
+    void pump(int from, int to, unsigned seed);
+
+    NetemOptions opts;
+    std::string target_host, local_host;
+    int target_port, local_port;
+    int listen_fd = -1;
+    std::thread acceptor;
+    std::vector<std::thread> pumps;
+    std::vector<int> fds;
+};
+
+#endif
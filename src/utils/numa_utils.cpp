@@ -0,0 +1,72 @@
+#include "numa_utils.h"
+#include <fmt/format.h>
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// from <numaif.h>
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+// Parse a sysfs list such as "0-3,8-11"
+static std::vector<int> parse_list(const std::string& list) {
+    std::vector<int> result;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        auto dash = range.find('-');
+        int lo = std::stoi(range.substr(0, dash));
+        int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+        for (int i = lo; i <= hi; i++)
+            result.push_back(i);
+    }
+    return result;
+}
+
+std::vector<int> numa_online_nodes() {
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string list;
+    if (!in || !std::getline(in, list))
+        return {0};
+    auto nodes = parse_list(list);
+    return nodes.empty() ? std::vector<int>{0} : nodes;
+}
+
+int numa_num_nodes() {
+    return numa_online_nodes().size();
+}
+
+std::vector<int> numa_node_cpus(int node) {
+    std::ifstream in(fmt::format("/sys/devices/system/node/node{}/cpulist", node));
+    std::string list;
+    if (!in || !std::getline(in, list))
+        return {};
+    return parse_list(list);
+}
+
+bool numa_bind_node(int node) {
+    // The kernel's node masks are capped well below this
+    const int max_node = 1024;
+    if (node < 0 || node >= max_node)
+        return false;
+    auto cpus = numa_node_cpus(node);
+    if (cpus.empty())
+        return false;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &cpu_set);
+    bool pinned = sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+
+    unsigned long node_mask[max_node / (8 * sizeof(unsigned long))] = {0};
+    node_mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    bool bound = syscall(SYS_set_mempolicy, MPOL_BIND, node_mask, max_node) == 0;
+
+    return pinned && bound;
+}
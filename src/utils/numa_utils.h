@@ -0,0 +1,24 @@
+#ifndef FABLE_NUMA_UTILS_H__
+#define FABLE_NUMA_UTILS_H__
+
+#include <string>
+#include <vector>
+
+// Minimal NUMA helpers based on sysfs and raw syscalls, so no libnuma is needed. 
+
+// Online NUMA nodes, in increasing order. Node ids need not be contiguous, e.g. {0, 2} with node 1 offline.
+// {0} on machines without NUMA support.
+std::vector<int> numa_online_nodes();
+
+// Number of online NUMA nodes (1 on machines without NUMA support)
+int numa_num_nodes();
+
+// CPUs of the given node, parsed from /sys/devices/system/node/node<node>/cpulist
+std::vector<int> numa_node_cpus(int node);
+
+// Pin the calling thread (and the threads it creates afterwards) to the CPUs of `node`, and bind its future
+// allocations to the node's memory, so that first-touched pages stay local. Both are per-thread settings, so threads
+// that already exist, such as an OpenMP pool, must bind themselves. Returns false if either step fails.
+bool numa_bind_node(int node);
+
+#endif
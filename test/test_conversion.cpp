@@ -0,0 +1,136 @@
+#include "GC/emp-sh2pc.h"
+#include "GC/conversion.h"
+#include "GC/share.h"
+#include "utils/io_utils.h"
+#include "utils/ubuntu_terminal_colors.h"
+#include <cstdint>
+#include <random>
+#include <fmt/core.h>
+
+using namespace sci;
+
+int party, port = 8000, batch_size = 256, seed = 12345;
+NetIO *io_gc;
+// Both parties draw the same plaintexts, so that each can check the opened results
+std::mt19937_64 generator;
+
+inline uint64_t mask_bits(int bits) {
+	return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+std::vector<uint64_t> random_values(int bits, size_t n = batch_size) {
+	std::vector<uint64_t> values(n);
+	for (auto& value : values)
+		value = generator() & mask_bits(bits);
+	return values;
+}
+
+void check_equal(const std::string& name, const std::vector<uint64_t>& result, const std::vector<uint64_t>& expected) {
+	if (result.size() != expected.size())
+		error(fmt::format("[{}] {} results, expected {}", name, result.size(), expected.size()).c_str());
+	for (size_t i = 0; i < expected.size(); i++)
+		if (result[i] != expected[i])
+			error(fmt::format("[{}] {}-th value incorrect! {} != {}", name, i, result[i], expected[i]).c_str());
+}
+
+// XOR shares of plain: ALICE holds a random mask, BOB the masked value
+std::vector<uint64_t> xor_share(const std::vector<uint64_t>& plain, int bits) {
+	auto masks = random_values(bits, plain.size());
+	std::vector<uint64_t> shares(plain.size());
+	for (size_t i = 0; i < plain.size(); i++)
+		shares[i] = party == ALICE ? masks[i] : plain[i] ^ masks[i];
+	return shares;
+}
+
+void test_tables() {
+	std::vector<int> widths{1, 17, 64};
+	for (int src_party : {ALICE, BOB}) {
+		std::vector<std::vector<uint64_t>> plain;
+		for (int width : widths)
+			plain.push_back(random_values(width));
+		auto secret = share_table(plain, widths, src_party, party);
+		auto opened = reveal_table(secret, PUBLIC, party);
+		for (size_t c = 0; c < widths.size(); c++)
+			check_equal(fmt::format("share_table {}-bit column from {}", widths[c], src_party), opened[c], plain[c]);
+
+		// Only to_party learns the column
+		auto column = reveal_column(secret[1], BOB, party);
+		check_equal("reveal_column", column, party == BOB ? plain[1] : std::vector<uint64_t>(batch_size, 0));
+	}
+}
+
+void test_xor_shares() {
+	for (int bits : {1, 13, 64}) {
+		auto plain = random_values(bits);
+		auto values = share_column(plain, bits, ALICE, party);
+
+		// Y2B, then B2Y back into the circuit
+		auto shares = to_xor_shares(values);
+		check_equal(fmt::format("Y2B {} bits", bits), open_shares(shares, 0, PUBLIC, party, io_gc), plain);
+		auto round_trip = from_xor_shares(shares, bits, party);
+		check_equal(fmt::format("B2Y {} bits", bits), reveal_column(round_trip, PUBLIC, party), plain);
+	}
+
+	auto plain = random_values(1);
+	BitArray bits(batch_size);
+	for (int i = 0; i < batch_size; i++)
+		bits[i] = Bit(plain[i], BOB);
+	check_equal("Y2B bits", open_shares(to_xor_shares(bits), 0, PUBLIC, party, io_gc), plain);
+}
+
+void test_additive_shares(ConversionContext& ctx) {
+	// The top bits of every ring exercise the j + 1 >= ring_bits corrections
+	std::vector<std::pair<int, int>> params{{1, 1}, {8, 8}, {13, 40}, {20, 20}, {63, 64}, {64, 64}};
+	for (auto [value_bits, ring_bits] : params) {
+		auto plain = random_values(value_bits);
+		auto shares = xor_to_additive(xor_share(plain, value_bits), value_bits, ring_bits, ctx);
+		for (auto share : shares)
+			if (share & ~mask_bits(ring_bits))
+				error(fmt::format("[B2A] share {} exceeds 2^{}", share, ring_bits).c_str());
+		check_equal(fmt::format("B2A {} bits mod 2^{}", value_bits, ring_bits), open_shares(shares, ring_bits, PUBLIC, party, io_gc), plain);
+	}
+
+	// Y2A with the default and a wider ring, then opened to a single party
+	auto plain = random_values(24);
+	auto values = share_column(plain, 24, BOB, party);
+	check_equal("Y2A", open_shares(to_additive_shares(values, ctx), 24, PUBLIC, party, io_gc), plain);
+	auto shares = to_shares(values, ShareType::additive, ctx, 48);
+	check_equal("Y2A mod 2^48", open_shares(shares, 48, ALICE, party, io_gc), party == ALICE ? plain : std::vector<uint64_t>(batch_size, 0));
+
+	// Sums of additive shares open to the sum of the values
+	std::vector<uint64_t> sum{0}, expected{0};
+	for (int i = 0; i < batch_size; i++) {
+		sum[0] += shares[i];
+		expected[0] += plain[i];
+	}
+	sum[0] &= mask_bits(48);
+	check_equal("Y2A sum", open_shares(sum, 48, PUBLIC, party, io_gc), expected);
+
+	auto bit_plain = random_values(1);
+	BitArray bits(batch_size);
+	for (int i = 0; i < batch_size; i++)
+		bits[i] = Bit(bit_plain[i], ALICE);
+	check_equal("Y2A bits", open_shares(to_additive_shares(bits, ctx, 32), 32, PUBLIC, party, io_gc), bit_plain);
+}
+
+int main(int argc, char **argv) {
+
+	ArgMapping amap;
+	amap.arg("r", party, "Role of party: ALICE = 1; BOB = 2");
+	amap.arg("p", port, "Port Number");
+	amap.arg("s", batch_size, "number of total elements");
+	amap.arg("seed", seed, "random seed, the same for both parties");
+	amap.parse(argc, argv);
+	generator.seed(seed);
+
+	io_gc = new NetIO(party == ALICE ? nullptr : "127.0.0.1",
+						port + GC_PORT_OFFSET, true);
+
+	setup_semi_honest(io_gc, party);
+	ConversionContext ctx(party, io_gc);
+
+	test_tables();
+	test_xor_shares();
+	test_additive_shares(ctx);
+	std::cout << GREEN << "Conversion test passed" << RESET << std::endl;
+}
@@ -0,0 +1,91 @@
+#include "GC/emp-sh2pc.h"
+#include "LUT_utils.h"
+#include "utils/ubuntu_terminal_colors.h"
+#include <cstdint>
+#include <cstdio>
+#include <fmt/core.h>
+
+using namespace sci;
+
+int seed = 12345;
+std::string filename = "test_lut_file.bin";
+
+void check_equal(const std::string& name, const std::vector<uint64_t>& result, const std::vector<uint64_t>& expected) {
+	if (result.size() != expected.size())
+		error(fmt::format("[{}] {} rows, expected {}", name, result.size(), expected.size()).c_str());
+	for (size_t i = 0; i < expected.size(); i++)
+		if (result[i] != expected[i])
+			error(fmt::format("[{}] {}-th row incorrect! {} != {}", name, i, result[i], expected[i]).c_str());
+}
+
+// Any row range of a Random LUT is derived on its own, so tiles agree with the whole table
+void test_rows() {
+	auto lut = get_lut_vec(LUTType::Random, 1000, seed, 10, 37);
+	std::vector<uint64_t> rows(300);
+	fill_lut_rows(LUTType::Random, 500, rows.size(), 1000, seed, 37, rows.data());
+	check_equal("row range", rows, std::vector<uint64_t>(lut.begin() + 500, lut.begin() + 800));
+}
+
+// Tiles of 300 rows do not divide the LUT, and the widths cover sub-byte, odd and full words
+void test_round_trip() {
+	for (int output_bits : {5, 37, 64}) {
+		dump_lut_binary(filename, LUTType::Random, 1000, seed, 10, output_bits, 300);
+		LUTFileHeader header;
+		auto lut = load_lut_binary(filename, &header);
+		if (header.input_bits != 10 || header.output_bits != output_bits || header.lut_size != 1000)
+			error(fmt::format("[LUT file] header {} {} {}", header.input_bits, header.output_bits, header.lut_size).c_str());
+		check_equal(fmt::format("LUT file {} bits", output_bits), lut, get_lut_vec(LUTType::Random, 1000, seed, 10, output_bits));
+	}
+}
+
+// The error dump_lut_binary accumulates over its tiles is the error of the whole LUT
+void test_error() {
+	auto stats = dump_lut_binary(filename, LUTType::Gamma, 1000, seed, 10, 16, 300);
+	auto expected = get_lut_error(LUTType::Gamma, get_lut_vec(LUTType::Gamma, 1000, seed, 10, 16), 16);
+	if (stats.max_abs_error != expected.max_abs_error || stats.max_rel_error != expected.max_rel_error)
+		error(fmt::format("[LUT file] error {} {}, expected {} {}", stats.max_abs_error, stats.max_rel_error, expected.max_abs_error, expected.max_rel_error).c_str());
+}
+
+// Corrupt headers and truncated files are rejected before anything is allocated
+void test_rejects() {
+	auto rejects = [&](const LUTFileHeader& header, uint64_t rows) {
+		std::ofstream out(filename, std::ios::binary);
+		out.write((const char*)&header, sizeof(header));
+		std::vector<char> body(rows * lut_row_bytes(header.output_bits), 0);
+		out.write(body.data(), body.size());
+		out.close();
+		try {
+			load_lut_binary(filename);
+		} catch (const std::runtime_error&) {
+			return true;
+		}
+		return false;
+	};
+	std::vector<std::pair<LUTFileHeader, uint64_t>> bad{
+		{{{'F', 'L', 'U', 'X'}, 10, 16, 0, 16}, 16},
+		{{{'F', 'L', 'U', 'T'}, 10, 65, 0, 16}, 16},
+		{{{'F', 'L', 'U', 'T'}, 0, 16, 0, 1}, 1},
+		{{{'F', 'L', 'U', 'T'}, 4, 16, 0, 17}, 17},
+		{{{'F', 'L', 'U', 'T'}, 10, 16, 0, 16}, 15},
+		{{{'F', 'L', 'U', 'T'}, 40, 16, 0, 1ULL << 40}, 1},
+	};
+	for (size_t i = 0; i < bad.size(); i++)
+		if (!rejects(bad[i].first, bad[i].second))
+			error(fmt::format("[LUT file] bad file {} was accepted", i).c_str());
+	if (rejects({{'F', 'L', 'U', 'T'}, 4, 16, 0, 16}, 16))
+		error("[LUT file] a valid file was rejected");
+}
+
+int main(int argc, char **argv) {
+
+	ArgMapping amap;
+	amap.arg("seed", seed, "random seed");
+	amap.parse(argc, argv);
+
+	test_rows();
+	test_round_trip();
+	test_error();
+	test_rejects();
+	std::remove(filename.c_str());
+	std::cout << GREEN << "LUT file test passed" << RESET << std::endl;
+}
@@ -0,0 +1,97 @@
+#include "GC/emp-sh2pc.h"
+#include "OT/splut.h"
+#include "utils/io_utils.h"
+#include "utils/ubuntu_terminal_colors.h"
+#include <cstdint>
+#include <map>
+#include <random>
+#include <type_traits>
+#include <fmt/core.h>
+#include <libOTe/Tools/Coproto.h>
+
+using namespace sci;
+
+int party, port = 8000, batch_size = 256, seed = 12345;
+// Both parties draw the same plaintexts, so that each can check the opened results
+std::mt19937_64 generator;
+
+inline uint64_t mask_bits(int bits) {
+	return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+std::vector<uint64_t> random_values(int bits, size_t n = batch_size) {
+	std::vector<uint64_t> values(n);
+	for (auto& value : values)
+		value = generator() & mask_bits(bits);
+	return values;
+}
+
+void check_equal(const std::string& name, const std::vector<uint64_t>& result, const std::vector<uint64_t>& expected) {
+	if (result.size() != expected.size())
+		error(fmt::format("[{}] {} results, expected {}", name, result.size(), expected.size()).c_str());
+	for (size_t i = 0; i < expected.size(); i++)
+		if (result[i] != expected[i])
+			error(fmt::format("[{}] {}-th value incorrect! {} != {}", name, i, result[i], expected[i]).c_str());
+}
+
+// SPLUT+ packs its online messages a word at a time and streams them through bounded buffers: cover widths that do and
+// do not divide a word, and memory bounds small enough to take several rounds of the buffers with a short last chunk.
+// Word selects SPLUT_wide for outputs beyond 32 bits.
+// The query words are XOR shared, ALICE holding a random mask and BOB the masked value; the opened results are checked.
+template<typename Word = uint32_t>
+void check_splut(cp::AsioSocket& chl, int l_in, int l_out, uint64_t max_memory, bool use_map = false) {
+	auto lut = random_values(l_out, 1ULL << l_in);
+	auto plain = random_values(l_in);
+	auto masks = random_values(l_in);
+	std::vector<uint32_t> x(batch_size);
+	for (int i = 0; i < batch_size; i++)
+		x[i] = party == ALICE ? masks[i] : plain[i] ^ masks[i];
+
+	std::vector<uint64_t> result;
+	if constexpr (!std::is_same_v<Word, uint32_t>) {
+		std::vector<Word> wide_lut(lut.begin(), lut.end());
+		auto shares = SPLUT_wide<Word>(wide_lut, x, l_out, l_in, party, chl, 2, max_memory);
+		result.assign(shares.begin(), shares.end());
+	} else if (use_map) {
+		std::map<uint64_t, uint64_t> lut_map;
+		for (uint64_t i = 0; i < lut.size(); i++)
+			lut_map[i] = lut[i];
+		auto shares = SPLUT(lut_map, x, l_out, l_in, party, chl, 2, 0, max_memory);
+		result.assign(shares.begin(), shares.end());
+	} else {
+		auto shares = SPLUT(lut, x, l_out, l_in, party, chl, 2, max_memory);
+		result.assign(shares.begin(), shares.end());
+	}
+	std::vector<uint64_t> peer(batch_size);
+	cp::sync_wait(chl.send(result));
+	cp::sync_wait(chl.recv(peer));
+
+	std::vector<uint64_t> expected(batch_size);
+	for (int i = 0; i < batch_size; i++) {
+		result[i] ^= peer[i];
+		expected[i] = lut[plain[i]];
+	}
+	check_equal(fmt::format("SPLUT+ {} -> {} bits{}, max_memory {}", l_in, l_out, use_map ? " from a map" : "", max_memory), result, expected);
+}
+
+int main(int argc, char **argv) {
+
+	ArgMapping amap;
+	amap.arg("r", party, "Role of party: ALICE = 1; BOB = 2");
+	amap.arg("p", port, "Port Number");
+	amap.arg("s", batch_size, "number of total elements");
+	amap.arg("seed", seed, "random seed, the same for both parties");
+	amap.parse(argc, argv);
+	generator.seed(seed);
+
+	auto chl = cp::asioConnect(fmt::format("127.0.0.1:{}", port), party == ALICE);
+	check_splut(chl, 8, 5, 0);
+	check_splut(chl, 8, 5, 1 << 10);
+	check_splut(chl, 10, 13, 1 << 12);
+	check_splut(chl, 8, 32, 0);
+	check_splut(chl, 6, 11, 1 << 9, true);
+	check_splut<uint64_t>(chl, 8, 47, 1 << 12);
+	check_splut<uint64_t>(chl, 6, 64, 0);
+	cp::sync_wait(chl.flush());
+	std::cout << GREEN << "SPLUT+ online test passed" << RESET << std::endl;
+}